@@ -21,7 +21,7 @@ template<auto F> struct wrapOpenGLES : wrapOpenGLESImpl<F, decltype(F)> {
     
 };
 
-void ArmhfSupport::install(std::unordered_map<std::string, void*>& overrides) {
+void ArmhfSupport::install(std::unordered_map<std::string_view, void*>& overrides) {
     auto procFunc = GameWindowManager::getManager()->getProcAddrFunc();
 #include "opengl_es_2_map.h"
 }
@@ -1,8 +1,8 @@
 #pragma once
 #include <unordered_map>
-#include <string>
+#include <string_view>
 
 class ArmhfSupport {
 public:
-    static void install(std::unordered_map<std::string, void*>& overrides);
+    static void install(std::unordered_map<std::string_view, void*>& overrides);
 };
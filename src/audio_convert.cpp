@@ -0,0 +1,164 @@
+#include "audio_convert.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+void AudioConvert::s16ToFloat(const int16_t* in, float* out, size_t samples) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(1.0f / 32768);
+    for(; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        // Sign extend by placing each sample in the upper half and shifting it back down
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#elif defined(__ARM_NEON)
+    for(; i + 8 <= samples; i += 8) {
+        int16x8_t v = vld1q_s16(in + i);
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), 1.0f / 32768));
+        vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), 1.0f / 32768));
+    }
+#endif
+    for(; i < samples; i++) {
+        out[i] = in[i] * (1.0f / 32768);
+    }
+}
+
+void AudioConvert::s32ToFloat(const int32_t* in, float* out, size_t samples) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+    for(; i + 4 <= samples; i += 4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(in + i))), scale));
+    }
+#elif defined(__ARM_NEON)
+    for(; i + 4 <= samples; i += 4) {
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(in + i)), 1.0f / 2147483648.0f));
+    }
+#endif
+    for(; i < samples; i++) {
+        out[i] = in[i] * (1.0f / 2147483648.0f);
+    }
+}
+
+void AudioConvert::s24PackedToFloat(const uint8_t* in, float* out, size_t samples) {
+    // Three byte samples do not line up with vector lanes, this is rare enough to stay scalar
+    for(size_t i = 0; i < samples; i++) {
+        int32_t v = (int32_t)((uint32_t)in[i * 3] << 8 | (uint32_t)in[i * 3 + 1] << 16 | (uint32_t)in[i * 3 + 2] << 24) >> 8;
+        out[i] = v * (1.0f / 8388608);
+    }
+}
+
+// Left and right gains of each input channel for the Android channel orders with 3 to 8 channels,
+// center and surrounds go in at -3 dB (ITU-R BS.775) and the LFE is dropped
+static bool stereoDownmixGains(int channels, float* left, float* right) {
+    constexpr float k = 0.70710678f;
+    static const float layouts[6][8][2] = {
+        // FL FR FC
+        {{1, 0}, {0, 1}, {k, k}},
+        // FL FR BL BR
+        {{1, 0}, {0, 1}, {k, 0}, {0, k}},
+        // FL FR FC BL BR
+        {{1, 0}, {0, 1}, {k, k}, {k, 0}, {0, k}},
+        // FL FR FC LFE BL BR
+        {{1, 0}, {0, 1}, {k, k}, {0, 0}, {k, 0}, {0, k}},
+        // FL FR FC LFE BC SL SR
+        {{1, 0}, {0, 1}, {k, k}, {0, 0}, {0.5f, 0.5f}, {k, 0}, {0, k}},
+        // FL FR FC LFE BL BR SL SR
+        {{1, 0}, {0, 1}, {k, k}, {0, 0}, {k, 0}, {0, k}, {k, 0}, {0, k}},
+    };
+    if(channels < 3 || channels > 8) {
+        return false;
+    }
+    const float(*gains)[2] = layouts[channels - 3];
+    // Scale so a full scale signal on every channel still fits, like SDL's own downmix matrices
+    float sum = 0;
+    for(int c = 0; c < channels; c++) {
+        sum += gains[c][0];
+    }
+    for(int c = 0; c < channels; c++) {
+        left[c] = gains[c][0] / sum;
+        right[c] = gains[c][1] / sum;
+    }
+    return true;
+}
+
+void AudioConvert::remix(const float* in, int inChannels, float* out, int outChannels, size_t frames) {
+    if(inChannels == outChannels) {
+        memcpy(out, in, frames * inChannels * sizeof(float));
+        return;
+    }
+    size_t i = 0;
+    if(inChannels == 1 && outChannels == 2) {
+#if defined(__SSE2__)
+        for(; i + 4 <= frames; i += 4) {
+            __m128 v = _mm_loadu_ps(in + i);
+            _mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(v, v));
+            _mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(v, v));
+        }
+#elif defined(__ARM_NEON)
+        for(; i + 4 <= frames; i += 4) {
+            float32x4_t v = vld1q_f32(in + i);
+            vst2q_f32(out + i * 2, (float32x4x2_t{{v, v}}));
+        }
+#endif
+    } else if(inChannels == 2 && outChannels == 1) {
+#if defined(__SSE2__)
+        const __m128 half = _mm_set1_ps(0.5f);
+        for(; i + 4 <= frames; i += 4) {
+            __m128 a = _mm_loadu_ps(in + i * 2);
+            __m128 b = _mm_loadu_ps(in + i * 2 + 4);
+            __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(left, right), half));
+        }
+#elif defined(__ARM_NEON)
+        for(; i + 4 <= frames; i += 4) {
+            float32x4x2_t v = vld2q_f32(in + i * 2);
+            vst1q_f32(out + i, vmulq_n_f32(vaddq_f32(v.val[0], v.val[1]), 0.5f));
+        }
+#endif
+    }
+    float left[8], right[8];
+    if(outChannels <= 2 && stereoDownmixGains(inChannels, left, right)) {
+        for(; i < frames; i++) {
+            const float* src = in + i * inChannels;
+            float l = 0, r = 0;
+            for(int c = 0; c < inChannels; c++) {
+                l += src[c] * left[c];
+                r += src[c] * right[c];
+            }
+            if(outChannels == 1) {
+                out[i] = (l + r) * 0.5f;
+            } else {
+                out[i * 2] = l;
+                out[i * 2 + 1] = r;
+            }
+        }
+        return;
+    }
+    for(; i < frames; i++) {
+        const float* src = in + i * inChannels;
+        float* dst = out + i * outChannels;
+        if(inChannels == 1) {
+            std::fill(dst, dst + outChannels, src[0]);
+        } else if(outChannels == 1) {
+            float sum = 0;
+            for(int c = 0; c < inChannels; c++) {
+                sum += src[c];
+            }
+            dst[0] = sum / inChannels;
+        } else {
+            int shared = std::min(inChannels, outChannels);
+            std::copy(src, src + shared, dst);
+            std::fill(dst + shared, dst + outChannels, 0.0f);
+        }
+    }
+}
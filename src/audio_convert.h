@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Sample format and channel conversions for the AAudio emulation, vectorized with SSE2 or NEON where available
+struct AudioConvert {
+    static void s16ToFloat(const int16_t* in, float* out, size_t samples);
+    static void s32ToFloat(const int32_t* in, float* out, size_t samples);
+    static void s24PackedToFloat(const uint8_t* in, float* out, size_t samples);
+    // Interleaved remix, mono to many copies the channel, surround to stereo or mono downmixes with center and surrounds at -3 dB,
+    // many to mono averages, otherwise shared channels are kept and extra outputs are silent
+    static void remix(const float* in, int inChannels, float* out, int outChannels, size_t frames);
+};
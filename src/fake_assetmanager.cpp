@@ -183,21 +183,24 @@ const char *AAssetDir_getNextFileName(AAssetDir *assetDir) {
 
 }  // namespace fake_assetmanager
 
-void FakeAssetManager::initHybrisHooks(std::unordered_map<std::string, void *> &syms) {
+HookTable FakeAssetManager::getHybrisHooks() {
     using namespace fake_assetmanager;
-    syms["AAssetManager_open"] = (void *)AAssetManager_open;
-    syms["AAssetManager_openDir"] = (void *)AAssetManager_openDir;
-    syms["AAsset_close"] = (void *)AAsset_close;
-    syms["AAsset_isAllocated"] = (void *)AAsset_isAllocated;
-    syms["AAsset_read"] = (void *)AAsset_read;
-    syms["AAsset_seek64"] = (void *)AAsset_seek64;
-    syms["AAsset_seek"] = (void *)AAsset_seek;
-    syms["AAsset_getLength64"] = (void *)AAsset_getLength64;
-    syms["AAsset_getLength"] = (void *)AAsset_getLength;
-    syms["AAsset_getRemainingLength64"] = (void *)AAsset_getRemainingLength64;
-    syms["AAsset_getRemainingLength"] = (void *)AAsset_getRemainingLength;
-    syms["AAsset_getBuffer"] = (void *)AAsset_getBuffer;
-    syms["AAssetDir_close"] = (void *)AAssetDir_close;
-    syms["AAssetDir_rewind"] = (void *)AAssetDir_rewind;
-    syms["AAssetDir_getNextFileName"] = (void *)AAssetDir_getNextFileName;
+    static const std::pair<const char *, void *> hooks[] = {
+        {"AAssetManager_open", (void *)AAssetManager_open},
+        {"AAssetManager_openDir", (void *)AAssetManager_openDir},
+        {"AAsset_close", (void *)AAsset_close},
+        {"AAsset_isAllocated", (void *)AAsset_isAllocated},
+        {"AAsset_read", (void *)AAsset_read},
+        {"AAsset_seek64", (void *)AAsset_seek64},
+        {"AAsset_seek", (void *)AAsset_seek},
+        {"AAsset_getLength64", (void *)AAsset_getLength64},
+        {"AAsset_getLength", (void *)AAsset_getLength},
+        {"AAsset_getRemainingLength64", (void *)AAsset_getRemainingLength64},
+        {"AAsset_getRemainingLength", (void *)AAsset_getRemainingLength},
+        {"AAsset_getBuffer", (void *)AAsset_getBuffer},
+        {"AAssetDir_close", (void *)AAssetDir_close},
+        {"AAssetDir_rewind", (void *)AAssetDir_rewind},
+        {"AAssetDir_getNextFileName", (void *)AAssetDir_getNextFileName},
+    };
+    return hooks;
 }
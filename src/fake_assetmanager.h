@@ -4,6 +4,7 @@
 #include <memory>
 #include <unordered_map>
 #include <utility>
+#include "hook_table.h"
 
 struct AAssetManager;
 
@@ -12,7 +13,7 @@ struct FakeAssetManager {
 
     FakeAssetManager(std::string rootDir);
 
-    static void initHybrisHooks(std::unordered_map<std::string, void *> &syms);
+    static HookTable getHybrisHooks();
 
     explicit operator AAssetManager *() const {
         return (AAssetManager *)this;
@@ -4,126 +4,346 @@
 #include <game_window_manager.h>
 #include <mcpelauncher/fmod_utils.h>
 #include <thread>
+#include <algorithm>
+#include <string>
+#include <time.h>
+#include <log.h>
 #include "util.h"
+#include "audio_convert.h"
 
 int32_t FakeAudio::defaultSampleRate = 48000;
 int32_t FakeAudio::defaultNumChannels = 2;
 int32_t FakeAudio::defaultBufSize = 512;
-void FakeAudio::initHybrisHooks(std::unordered_map<std::string, void *> &syms) {
-    syms["AAudioStreamBuilder_openStream"] = (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, FakeAudioStream *_Nullable *_Nonnull stream) -> aaudio_result_t {
-        *stream = new FakeAudioStream{.dataCallback = builder->dataCallback, .dataCallbackUser = builder->dataCallbackUser, .errorCallback = builder->errorCallback, .errorCallbackUser = builder->errorCallbackUser, .bufferCap = builder->bufferCap};
-        (*stream)->audioBufferSize = builder->bufferCap * (*stream)->getBytesPerSample() * (*stream)->channelCount;
-        (*stream)->audioBuffer = malloc((*stream)->audioBufferSize);
-        return AAUDIO_OK;
-    };
-    syms["AAudio_createStreamBuilder"] = (void *)+[](FakeAudioStreamBuilder *_Nullable *_Nonnull builder) -> aaudio_result_t {
-        *builder = new FakeAudioStreamBuilder{};
-        return AAUDIO_OK;
-    };
-    syms["AAudioStreamBuilder_setBufferCapacityInFrames"] = (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, int32_t newCap) -> void {
-        builder->bufferCap = newCap;
-    };
-    syms["AAudioStreamBuilder_setDataCallback"] = (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, AAudioStream_dataCallback _Nullable callback, void *_Nullable userData) {
-        builder->dataCallback = callback;
-        builder->dataCallbackUser = userData;
-    };
-    syms["AAudioStream_getXRunCount"] = (void *)+[]() -> int32_t {
-        return 0;
-    };
-    syms["AAudioStreamBuilder_setErrorCallback"] = (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, AAudioStream_errorCallback _Nullable callback, void *_Nullable userData) {
-        builder->errorCallback = callback;
-        builder->errorCallbackUser = userData;
-    };
-    syms["AAudioStream_getBufferSizeInFrames"] = (void *)+[](FakeAudioStream *_Nonnull stream) -> int32_t {
-        return stream->bufferSize;
-    };
-    syms["AAudioStream_close"] = (void *)+[](FakeAudioStream *_Nonnull stream) {
-        free(stream->audioBuffer);
-        stream->audioBuffer = NULL;
-        stream->audioBufferSize = 0;
-    };
-    syms["AAudioStreamBuilder_setDirection"] = (void *)+[](AAudioStreamBuilder *_Nonnull builder, aaudio_direction_t direction) {
-    };
-    syms["AAudioStream_setBufferSizeInFrames"] = (void *)+[](FakeAudioStream *_Nonnull stream, int32_t newSize) -> void {
-        stream->bufferSize = newSize;
-        stream->audioBufferSize = stream->bufferSize * stream->channelCount * stream->getBytesPerSample();
-        stream->audioBuffer = realloc(stream->audioBuffer, stream->audioBufferSize);
-    };
-    syms["AAudioStream_getChannelCount"] = (void *)+[](FakeAudioStream *_Nonnull stream) -> int32_t {
-        return stream->channelCount;
-    };
-    syms["AAudioStream_getFramesPerBurst"] = (void *)+[](FakeAudioStream *_Nonnull stream) -> int32_t {
-        return stream->bufferSize;
-    };
-    syms["AAudioStreamBuilder_delete"] = (void *)+[]() {
-    };
-    syms["AAudioStream_requestStop"] = (void *)+[](FakeAudioStream *_Nonnull stream) {
-        SDL_AudioStream *s = stream->s;
-        stream->s = NULL;
-        SDL_DestroyAudioStream(s);
-    };
-    syms["AAudioStream_getBufferCapacityInFrames"] = (void *)+[](FakeAudioStream *_Nonnull stream) -> int32_t {
-        return stream->bufferCap;
-    };
-    syms["AAudioStreamBuilder_setInputPreset"] = (void *)+[]() {
-    };
-    syms["AAudioStream_getSampleRate"] = (void *)+[](FakeAudioStream *_Nonnull stream) -> int32_t {
-        return stream->sampleRate;
-    };
-    syms["AAudioStream_read"] = (void *)+[]() {
-    };
-    syms["AAudioStreamBuilder_setPerformanceMode"] = (void *)+[](AAudioStreamBuilder *_Nonnull builder, aaudio_performance_mode_t mode) -> void {
+aaudio_format_t FakeAudio::defaultFormat = AAUDIO_FORMAT_PCM_I16;
+std::atomic<FakeAudio::FakeAudioStream *> FakeAudio::activeStream{nullptr};
+
+static const int64_t lowLatencyShrinkAfterNanos = 10LL * 1000000000;
+
+static int64_t nowNanos(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+HookTable FakeAudio::getHybrisHooks() {
+    static const std::pair<const char *, void *> hooks[] = {
+        {"AAudioStreamBuilder_openStream", (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, FakeAudioStream *_Nullable *_Nonnull stream) -> aaudio_result_t {
+             // The conversion below only knows these, anything else would be read with the wrong sample size
+             auto requested = builder->format != AAUDIO_FORMAT_UNSPECIFIED ? builder->format : defaultFormat;
+             if(requested != AAUDIO_FORMAT_PCM_I16 && requested != AAUDIO_FORMAT_PCM_I24_PACKED && requested != AAUDIO_FORMAT_PCM_I32 && requested != AAUDIO_FORMAT_PCM_FLOAT) {
+                 return AAUDIO_ERROR_INVALID_FORMAT;
+             }
+             *stream = new FakeAudioStream{.dataCallback = builder->dataCallback, .dataCallbackUser = builder->dataCallbackUser, .errorCallback = builder->errorCallback, .errorCallbackUser = builder->errorCallbackUser, .bufferCap = builder->bufferCap, .performanceMode = builder->performanceMode, .sampleRate = builder->sampleRate > 0 ? builder->sampleRate : defaultSampleRate, .channelCount = builder->channelCount > 0 ? builder->channelCount : defaultNumChannels, .format = requested};
+             // Larger device requests are split into several data callbacks instead of growing the buffer on the audio thread
+             size_t frames = (*stream)->audioBufferFrames = std::max({builder->bufferCap, defaultBufSize, 256});
+             (*stream)->audioBuffer = malloc(frames * (*stream)->getBytesPerFrame());
+             // SDL has no packed 24 bit format, other channel counts are remixed here instead of in SDL's generic converter
+             auto format = (*stream)->format;
+             (*stream)->convert = (format != AAUDIO_FORMAT_PCM_I16 && format != AAUDIO_FORMAT_PCM_I32 && format != AAUDIO_FORMAT_PCM_FLOAT) || (*stream)->channelCount != defaultNumChannels;
+             if((*stream)->convert) {
+                 if(format != AAUDIO_FORMAT_PCM_FLOAT) {
+                     (*stream)->convertBuffer = (float *)malloc(frames * (*stream)->channelCount * sizeof(float));
+                 }
+                 (*stream)->deviceBuffer = (float *)malloc(frames * defaultNumChannels * sizeof(float));
+             }
+             return AAUDIO_OK;
+         }},
+        {"AAudio_createStreamBuilder", (void *)+[](FakeAudioStreamBuilder *_Nullable *_Nonnull builder) -> aaudio_result_t {
+             *builder = new FakeAudioStreamBuilder{};
+             return AAUDIO_OK;
+         }},
+        {"AAudioStreamBuilder_setFormat", (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, aaudio_format_t format) -> void {
+             builder->format = format;
+         }},
+        {"AAudioStreamBuilder_setChannelCount", (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, int32_t channelCount) -> void {
+             builder->channelCount = channelCount;
+         }},
+        // Older name of setChannelCount
+        {"AAudioStreamBuilder_setSamplesPerFrame", (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, int32_t channelCount) -> void {
+             builder->channelCount = channelCount;
+         }},
+        {"AAudioStreamBuilder_setSampleRate", (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, int32_t sampleRate) -> void {
+             builder->sampleRate = sampleRate;
+         }},
+        {"AAudioStreamBuilder_setBufferCapacityInFrames", (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, int32_t newCap) -> void {
+             builder->bufferCap = newCap;
+         }},
+        {"AAudioStreamBuilder_setDataCallback", (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, AAudioStream_dataCallback _Nullable callback, void *_Nullable userData) {
+             builder->dataCallback = callback;
+             builder->dataCallbackUser = userData;
+         }},
+        {"AAudioStream_getXRunCount", (void *)+[](FakeAudioStream *_Nonnull stream) -> int32_t {
+             return stream->xRunCount.load(std::memory_order_relaxed);
+         }},
+        {"AAudioStream_getFramesWritten", (void *)+[](FakeAudioStream *_Nonnull stream) -> int64_t {
+             return stream->framesWritten.load(std::memory_order_relaxed);
+         }},
+        {"AAudioStream_getFramesRead", (void *)+[](FakeAudioStream *_Nonnull stream) -> int64_t {
+             int64_t written = stream->framesWritten.load(std::memory_order_relaxed);
+             // Frames still queued in SDL have not been consumed by the device yet
+             int queued = stream->s ? SDL_GetAudioStreamQueued(stream->s) : 0;
+             return std::max<int64_t>(written - (queued > 0 ? queued / stream->deviceBytesPerFrame : 0), 0);
+         }},
+        {"AAudioStream_getTimestamp", (void *)+[](FakeAudioStream *_Nonnull stream, clockid_t clockid, int64_t *_Nonnull framePosition, int64_t *_Nonnull timeNanoseconds) -> aaudio_result_t {
+             if(!stream->s) {
+                 return AAUDIO_ERROR_INVALID_STATE;
+             }
+             int64_t frames, nanos;
+             uint32_t seq;
+             do {
+                 seq = stream->timestampSeq.load(std::memory_order_acquire);
+                 frames = stream->timestampFrames.load(std::memory_order_relaxed);
+                 nanos = stream->timestampNanos.load(std::memory_order_relaxed);
+                 // Keeps the data loads above from moving past the recheck
+                 std::atomic_thread_fence(std::memory_order_acquire);
+             } while((seq & 1) || seq != stream->timestampSeq.load(std::memory_order_relaxed));
+             if(nanos == 0) {
+                 return AAUDIO_ERROR_INVALID_STATE;
+             }
+             if(clockid != CLOCK_MONOTONIC) {
+                 nanos += nowNanos(clockid) - nowNanos(CLOCK_MONOTONIC);
+             }
+             *framePosition = frames;
+             *timeNanoseconds = nanos;
+             return AAUDIO_OK;
+         }},
+        {"AAudioStreamBuilder_setErrorCallback", (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, AAudioStream_errorCallback _Nullable callback, void *_Nullable userData) {
+             builder->errorCallback = callback;
+             builder->errorCallbackUser = userData;
+         }},
+        {"AAudioStream_getBufferSizeInFrames", (void *)+[](FakeAudioStream *_Nonnull stream) -> int32_t {
+             return stream->bufferSize;
+         }},
+        {"AAudioStream_close", (void *)+[](FakeAudioStream *_Nonnull stream) {
+             FakeAudioStream *expected = stream;
+             activeStream.compare_exchange_strong(expected, nullptr);
+             // Destroying the sdl stream waits for a running callback, only then the buffer can go away
+             SDL_AudioStream *s = stream->s;
+             stream->s = NULL;
+             SDL_DestroyAudioStream(s);
+             free(stream->audioBuffer);
+             free(stream->convertBuffer);
+             free(stream->deviceBuffer);
+             stream->audioBuffer = NULL;
+             stream->convertBuffer = NULL;
+             stream->deviceBuffer = NULL;
+             stream->audioBufferFrames = 0;
+         }},
+        {"AAudioStreamBuilder_setDirection", (void *)+[](AAudioStreamBuilder *_Nonnull builder, aaudio_direction_t direction) {
+         }},
+        {"AAudioStream_setBufferSizeInFrames", (void *)+[](FakeAudioStream *_Nonnull stream, int32_t newSize) -> aaudio_result_t {
+             if(newSize < 0) {
+                 return AAUDIO_ERROR_OUT_OF_RANGE;
+             }
+             // Like AAudio the size is clamped to the capacity, the preallocated buffer already covers it
+             newSize = std::min(std::max(newSize, 1), stream->bufferCap);
+             stream->requestedBufferSize.store(newSize, std::memory_order_relaxed);
+             stream->bufferSize.store(newSize, std::memory_order_relaxed);
+             return newSize;
+         }},
+        {"AAudioStream_getChannelCount", (void *)+[](FakeAudioStream *_Nonnull stream) -> int32_t {
+             return stream->channelCount;
+         }},
+        {"AAudioStream_getFramesPerBurst", (void *)+[](FakeAudioStream *_Nonnull stream) -> int32_t {
+             if(stream->performanceMode == AAUDIO_PERFORMANCE_MODE_LOW_LATENCY) {
+                 return stream->framesPerBurst;
+             }
+             return stream->bufferSize;
+         }},
+        {"AAudioStreamBuilder_delete", (void *)+[]() {
+         }},
+        {"AAudioStream_requestStop", (void *)+[](FakeAudioStream *_Nonnull stream) {
+             FakeAudioStream *expected = stream;
+             activeStream.compare_exchange_strong(expected, nullptr);
+             SDL_AudioStream *s = stream->s;
+             stream->s = NULL;
+             SDL_DestroyAudioStream(s);
+         }},
+        {"AAudioStream_getBufferCapacityInFrames", (void *)+[](FakeAudioStream *_Nonnull stream) -> int32_t {
+             return stream->bufferCap;
+         }},
+        {"AAudioStreamBuilder_setInputPreset", (void *)+[]() {
+         }},
+        {"AAudioStream_getSampleRate", (void *)+[](FakeAudioStream *_Nonnull stream) -> int32_t {
+             return stream->sampleRate;
+         }},
+        {"AAudioStream_read", (void *)+[]() {
+         }},
+        {"AAudioStreamBuilder_setPerformanceMode", (void *)+[](FakeAudioStreamBuilder *_Nonnull builder, aaudio_performance_mode_t mode) -> void {
+             builder->performanceMode = mode;
+         }},
+        {"AAudioStream_getState", (void *)+[](FakeAudioStream *_Nonnull stream) -> aaudio_stream_state_t {
+             if(!stream->s) {
+                 return AAUDIO_STREAM_STATE_CLOSED;
+             }
+             return SDL_AudioStreamDevicePaused(stream->s) ? AAUDIO_STREAM_STATE_PAUSED : AAUDIO_STREAM_STATE_STARTED;
+         }},
+        {"AAudioStream_getFormat", (void *)+[](FakeAudioStream *_Nonnull stream) -> aaudio_format_t {
+             return stream->format;
+         }},
+        {"AAudioStreamBuilder_setUsage", (void *)+[](AAudioStreamBuilder *_Nonnull builder, aaudio_usage_t usage) {
+         }},
+        {"AAudioStream_requestStart", (void *)+[](FakeAudioStream *_Nonnull stream) -> aaudio_result_t {
+             SDL_AudioSpec spec;
+             if(stream->convert) {
+                 spec.channels = defaultNumChannels;
+                 spec.format = SDL_AUDIO_F32;
+                 stream->deviceBytesPerFrame = defaultNumChannels * sizeof(float);
+             } else {
+                 spec.channels = stream->channelCount;
+                 switch(stream->format) {
+                 case AAUDIO_FORMAT_PCM_FLOAT:
+                     spec.format = SDL_AUDIO_F32;
+                     break;
+                 case AAUDIO_FORMAT_PCM_I32:
+                     spec.format = SDL_AUDIO_S32;
+                     break;
+                 default:
+                     spec.format = SDL_AUDIO_S16;
+                     break;
+                 }
+                 stream->deviceBytesPerFrame = stream->getBytesPerFrame();
+             }
+             spec.freq = stream->sampleRate;
+             stream->lastCallbackNanos = 0;
+             stream->stableSinceNanos = 0;
+             stream->headroomFrames = 0;
+             bool lowLatency = stream->performanceMode == AAUDIO_PERFORMANCE_MODE_LOW_LATENCY;
+             if(lowLatency) {
+                 // Smallest power of two period of at least 2.5 ms, shorter ones underrun on most desktop audio servers
+                 int32_t frames = 64;
+                 while(frames < stream->sampleRate / 400) {
+                     frames *= 2;
+                 }
+                 SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, std::to_string(frames).c_str());
+             }
+             stream->s = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, onAudioRequested, stream);
+             if(lowLatency) {
+                 SDL_ResetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES);
+             }
+             if(stream->s == NULL) {
+                 auto errormsg = SDL_GetError();
+                 GameWindowManager::getManager()->getErrorHandler()->onError("sdl3audio failed", std::string("sdl3audio SDL_OpenAudioDeviceStream failed, audio will be unavailable: ") + (errormsg ? errormsg : "No message from sdl3audio"));
+                 return AAUDIO_OK;  // fmod tries to open it over and over again if it fails
+             }
+             SDL_AudioSpec deviceSpec;
+             int deviceFrames = 0;
+             if(SDL_GetAudioDeviceFormat(SDL_GetAudioStreamDevice(stream->s), &deviceSpec, &deviceFrames) && deviceFrames > 0) {
+                 stream->framesPerBurst = deviceFrames;
+             }
+             if(lowLatency) {
+                 // Start with nothing queued beyond FMOD's size or the device period, the callback adds headroom when it underruns
+                 stream->bufferSize = std::min(std::max(stream->requestedBufferSize.load(), stream->framesPerBurst), stream->bufferCap);
+                 Log::info("FakeAudio", "Low latency mode, device period %d frames at %d Hz", stream->framesPerBurst, stream->sampleRate);
+             }
+             activeStream = stream;
+             SDL_ResumeAudioDevice(SDL_GetAudioStreamDevice(stream->s));
+
+             return AAUDIO_OK;
+         }},
     };
-    syms["AAudioStream_getState"] = (void *)+[](FakeAudioStream *_Nonnull stream) -> aaudio_stream_state_t {
-        if(!stream->s) {
-            return AAUDIO_STREAM_STATE_CLOSED;
+    return hooks;
+}
+
+void FakeAudio::onAudioRequested(void *userdata, SDL_AudioStream *sdlStream, int additional_amount, int total_amount) {
+    FakeAudioStream *stream = (FakeAudioStream *)userdata;
+    if(stream->dataCallback == NULL || stream->audioBuffer == NULL) {
+        return;
+    }
+    // Amounts in the sdl stream are in the device format, which differs from the data callback's when converting
+    int32_t bytesPerFrame = stream->deviceBytesPerFrame;
+    int32_t frames = additional_amount / bytesPerFrame;
+    int32_t burst = stream->framesPerBurst;
+    int64_t now = nowNanos(CLOCK_MONOTONIC);
+    // The device ran dry if more time passed than the previously queued frames and one device period cover
+    bool xRun = false;
+    if(stream->lastCallbackNanos != 0) {
+        int64_t covered = (int64_t)(stream->lastCallbackFrames + burst) * 1000000000 / stream->sampleRate;
+        if(now - stream->lastCallbackNanos > covered) {
+            stream->xRunCount.fetch_add(1, std::memory_order_relaxed);
+            xRun = true;
         }
-        return SDL_AudioStreamDevicePaused(stream->s) ? AAUDIO_STREAM_STATE_PAUSED : AAUDIO_STREAM_STATE_STARTED;
-    };
-    syms["AAudioStream_getFormat"] = (void *)+[](FakeAudioStream *_Nonnull stream) -> aaudio_format_t {
-        return stream->format;
-    };
-    syms["AAudioStreamBuilder_setUsage"] = (void *)+[](AAudioStreamBuilder *_Nonnull builder, aaudio_usage_t usage) {
-    };
-    syms["AAudioStream_requestStart"] = (void *)+[](FakeAudioStream *_Nonnull stream) -> aaudio_result_t {
-        SDL_AudioSpec spec;
-        spec.channels = stream->channelCount;
-        switch(stream->format) {
-        case AAUDIO_FORMAT_PCM_I16:
-            spec.format = SDL_AUDIO_S16LE;
-            break;
-        case AAUDIO_FORMAT_PCM_I32:
-            spec.format = SDL_AUDIO_S32LE;
-            break;
-        default:
-            spec.format = SDL_AUDIO_S16LE;
-            break;
+    }
+    stream->lastCallbackNanos = now;
+
+    int32_t queued = SDL_GetAudioStreamQueued(sdlStream) / bytesPerFrame;
+    if(stream->performanceMode == AAUDIO_PERFORMANCE_MODE_LOW_LATENCY) {
+        // FMOD's size is the floor, only the headroom above it adapts
+        int32_t floor = std::max(stream->requestedBufferSize.load(std::memory_order_relaxed), burst);
+        int32_t maxHeadroom = std::max(stream->bufferCap - floor, 0);
+        if(xRun || stream->stableSinceNanos == 0) {
+            if(xRun) {
+                stream->headroomFrames = std::min(stream->headroomFrames + burst, maxHeadroom);
+            }
+            stream->stableSinceNanos = now;
+        } else if(now - stream->stableSinceNanos > lowLatencyShrinkAfterNanos && stream->headroomFrames > 0) {
+            stream->headroomFrames = std::max(stream->headroomFrames - burst, 0);
+            stream->stableSinceNanos = now;
         }
-        spec.freq = stream->sampleRate;
-        stream->s = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, [](void *userdata, SDL_AudioStream *sdlStream, int additional_amount, int total_amount) {
-            FakeAudioStream *stream = (FakeAudioStream *)userdata; 
-            if(stream->dataCallback == NULL || stream->s == NULL || stream->audioBuffer == NULL) {
-                return;
+        int32_t bufferSize = floor + std::min(stream->headroomFrames, maxHeadroom);
+        stream->bufferSize.store(bufferSize, std::memory_order_relaxed);
+        // SDL only asks for what the device needs right now, keep the extra headroom queued ahead of it
+        frames += std::max(bufferSize - burst - queued, 0);
+    }
+
+    // Like getFramesRead minus the queued frames, and the device still has the period it pulled before playing these
+    int64_t position = std::max<int64_t>(stream->framesWritten.load(std::memory_order_relaxed) - queued - burst, 0);
+    uint32_t seq = stream->timestampSeq.load(std::memory_order_relaxed);
+    stream->timestampSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    stream->timestampFrames.store(position, std::memory_order_relaxed);
+    stream->timestampNanos.store(now, std::memory_order_relaxed);
+    stream->timestampSeq.store(seq + 2, std::memory_order_release);
+
+    while(frames > 0) {
+        int32_t chunk = std::min(frames, stream->audioBufferFrames);
+        stream->dataCallback((AAudioStream *)stream, stream->dataCallbackUser, stream->audioBuffer, chunk);
+        const void *out = stream->audioBuffer;
+        if(stream->convert) {
+            const float *samples = (const float *)stream->audioBuffer;
+            size_t count = (size_t)chunk * stream->channelCount;
+            switch(stream->format) {
+            case AAUDIO_FORMAT_PCM_I16:
+                AudioConvert::s16ToFloat((const int16_t *)stream->audioBuffer, stream->convertBuffer, count);
+                samples = stream->convertBuffer;
+                break;
+            case AAUDIO_FORMAT_PCM_I32:
+                AudioConvert::s32ToFloat((const int32_t *)stream->audioBuffer, stream->convertBuffer, count);
+                samples = stream->convertBuffer;
+                break;
+            case AAUDIO_FORMAT_PCM_I24_PACKED:
+                AudioConvert::s24PackedToFloat((const uint8_t *)stream->audioBuffer, stream->convertBuffer, count);
+                samples = stream->convertBuffer;
+                break;
+            default:
+                break;
             }
-            if (additional_amount > stream->audioBufferSize) {
-                stream->audioBufferSize = additional_amount;
-                stream->audioBuffer = realloc(stream->audioBuffer, stream->audioBufferSize);        
+            if(stream->channelCount != defaultNumChannels) {
+                AudioConvert::remix(samples, stream->channelCount, stream->deviceBuffer, defaultNumChannels, chunk);
+                samples = stream->deviceBuffer;
             }
-            stream->dataCallback((AAudioStream *)stream, stream->dataCallbackUser, stream->audioBuffer, additional_amount / (stream->channelCount * stream->getBytesPerSample()));
-            if(!SDL_PutAudioStreamData(stream->s, stream->audioBuffer, additional_amount)) {
-                if(stream->errorCallback != NULL) {
-                    stream->errorCallback((AAudioStream *)stream, stream->errorCallbackUser, AAUDIO_ERROR_DISCONNECTED);
-                }
-            } }, stream);
-        if(stream->s == NULL) {
-            auto errormsg = SDL_GetError();
-            GameWindowManager::getManager()->getErrorHandler()->onError("sdl3audio failed", std::string("sdl3audio SDL_OpenAudioDeviceStream failed, audio will be unavailable: ") + (errormsg ? errormsg : "No message from sdl3audio"));
-            return AAUDIO_OK;  // fmod tries to open it over and over again if it fails
+            out = samples;
         }
-        SDL_ResumeAudioDevice(SDL_GetAudioStreamDevice(stream->s));
+        if(!SDL_PutAudioStreamData(sdlStream, out, chunk * bytesPerFrame)) {
+            if(stream->errorCallback != NULL) {
+                stream->errorCallback((AAudioStream *)stream, stream->errorCallbackUser, AAUDIO_ERROR_DISCONNECTED);
+            }
+            return;
+        }
+        stream->framesWritten.fetch_add(chunk, std::memory_order_relaxed);
+        frames -= chunk;
+    }
+    // Nothing of this was taken by the device yet, it drains the queue after the callback returns
+    stream->lastCallbackFrames = SDL_GetAudioStreamQueued(sdlStream) / bytesPerFrame;
+    stream->latencyFrames.store(stream->lastCallbackFrames + burst, std::memory_order_relaxed);
+}
 
-        return AAUDIO_OK;
-    };
+FakeAudio::LatencyStats FakeAudio::getLatencyStats() {
+    FakeAudioStream *stream = activeStream.load();
+    if(!stream) {
+        return {};
+    }
+    return {true, stream->performanceMode == AAUDIO_PERFORMANCE_MODE_LOW_LATENCY, stream->latencyFrames.load(std::memory_order_relaxed) * 1000.0f / stream->sampleRate, stream->xRunCount.load(std::memory_order_relaxed)};
 }
 
 void FakeAudio::updateDefaults() {
@@ -134,6 +354,18 @@ void FakeAudio::updateDefaults() {
     defaultSampleRate = ReadEnvInt("AUDIO_SAMPLE_RATE", spec.freq);
     defaultNumChannels = spec.channels;
     defaultBufSize = sampleFrames;
+    // FMOD mixes in float, handing it the device format avoids converting twice
+    switch(spec.format) {
+    case SDL_AUDIO_F32:
+        defaultFormat = AAUDIO_FORMAT_PCM_FLOAT;
+        break;
+    case SDL_AUDIO_S32:
+        defaultFormat = AAUDIO_FORMAT_PCM_I32;
+        break;
+    default:
+        defaultFormat = AAUDIO_FORMAT_PCM_I16;
+        break;
+    }
 
     FmodUtils::setSampleRate(defaultSampleRate);
 }
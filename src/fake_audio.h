@@ -1,14 +1,17 @@
 #ifdef HAVE_SDL3AUDIO
+#include <atomic>
 #include <unordered_map>
 #include <string>
 #include <SDL3/SDL.h>
 #include <android/audio.h>
+#include "hook_table.h"
 
 class FakeAudio {
 private:
     static int32_t defaultSampleRate;
     static int32_t defaultNumChannels;
     static int32_t defaultBufSize;
+    static aaudio_format_t defaultFormat;
 
     struct FakeAudioStreamBuilder {
         AAudioStream_dataCallback _Nullable dataCallback = NULL;
@@ -18,6 +21,11 @@ private:
         void *_Nullable errorCallbackUser = NULL;
 
         int32_t bufferCap = defaultBufSize;
+        aaudio_performance_mode_t performanceMode = AAUDIO_PERFORMANCE_MODE_NONE;
+        // Unspecified values use the defaults of the sdl device
+        int32_t sampleRate = 0;
+        int32_t channelCount = 0;
+        aaudio_format_t format = AAUDIO_FORMAT_UNSPECIFIED;
     };
 
     struct FakeAudioStream {
@@ -28,17 +36,47 @@ private:
         void *_Nullable errorCallbackUser;
 
         int32_t bufferCap;
-        int32_t bufferSize = defaultBufSize;
+        aaudio_performance_mode_t performanceMode;
+        std::atomic<int32_t> bufferSize{defaultBufSize};
+        // Period of the sdl device, negotiated down in low latency mode
+        int32_t framesPerBurst = defaultBufSize;
         int32_t sampleRate = defaultSampleRate;
         int32_t channelCount = defaultNumChannels;
 
         aaudio_format_t format = AAUDIO_FORMAT_PCM_I16;
 
+        // Allocated once when opening, the audio thread never resizes or frees it
         void *_Nullable audioBuffer;
-        int audioBufferSize = 0;
+        int32_t audioBufferFrames = 0;
+        // Set when the stream format or channel count differs from the device, the data callback output goes through float
+        bool convert = false;
+        float *_Nullable convertBuffer = NULL;
+        float *_Nullable deviceBuffer = NULL;
+        int32_t deviceBytesPerFrame = 0;
 
         SDL_AudioStream *_Nullable s = NULL;
 
+        // Counters the data callback updates for FMOD's latency tuning
+        std::atomic<int64_t> framesWritten{0};
+        std::atomic<int32_t> xRunCount{0};
+        int64_t lastCallbackNanos = 0;
+        int32_t lastCallbackFrames = 0;
+        // Last size FMOD set, low latency mode never queues less than this
+        std::atomic<int32_t> requestedBufferSize{0};
+        // Low latency mode grows the headroom above the requested size on underruns and shrinks it again once this is
+        // long enough ago, bufferSize is the sum of both
+        int32_t headroomFrames = 0;
+        int64_t stableSinceNanos = 0;
+        std::atomic<int32_t> latencyFrames{0};
+        // Frame position and CLOCK_MONOTONIC time of the last callback, written under timestampSeq
+        std::atomic<uint32_t> timestampSeq{0};
+        std::atomic<int64_t> timestampFrames{0};
+        std::atomic<int64_t> timestampNanos{0};
+
+        int32_t getBytesPerFrame() {
+            return getBytesPerSample() * channelCount;
+        }
+
         int32_t getBytesPerSample() {
             switch(format) {
             case AAUDIO_FORMAT_INVALID:
@@ -56,10 +94,23 @@ private:
         }
     };
 
+    static std::atomic<FakeAudioStream *> activeStream;
+
+    static void onAudioRequested(void *_Nullable userdata, SDL_AudioStream *_Nonnull sdlStream, int additional_amount, int total_amount);
+
 public:
-    static void
-    initHybrisHooks(std::unordered_map<std::string, void *> &syms);
+    struct LatencyStats {
+        bool active;
+        bool lowLatency;
+        float latencyMs;
+        int32_t xRuns;
+    };
+
+    static HookTable getHybrisHooks();
 
     static void updateDefaults();
+
+    // Of the most recently started stream, shown in the fps hud
+    static LatencyStats getLatencyStats();
 };
 #endif
\ No newline at end of file
@@ -2,7 +2,14 @@
 #include "gl_core_patch.h"
 #include "settings.h"
 #include "imgui_ui.h"
+#include "frame_stats.h"
+#ifdef USE_IMGUI
+#include "gpu_timer.h"
+#include "frame_capture.h"
+#endif
+#include "hook_table.h"
 #include <map>
+#include <string_view>
 
 #define __ANDROID__
 #include <EGL/egl.h>
@@ -22,7 +29,8 @@ namespace fake_egl {
 
 static thread_local EGLSurface currentDrawSurface;
 static void *(*hostProcAddrFn)(const char *);
-static std::unordered_map<std::string, void *> hostProcOverrides;
+// Keyed by string_view so eglGetProcAddress can look up overrides without allocating, all keys are string literals
+static std::unordered_map<std::string_view, void *> hostProcOverrides;
 
 EGLBoolean eglInitialize(EGLDisplay display, EGLint *major, EGLint *minor) {
     if(major)
@@ -111,6 +119,7 @@ EGLBoolean eglMakeCurrent(EGLDisplay display, EGLSurface draw, EGLSurface read,
 }
 
 EGLBoolean eglSwapBuffers(EGLDisplay display, EGLSurface surface) {
+    FrameStats::recordFrame();
     if(FakeEGL::swapBuffersCallbacksLock.try_lock()) {
         for(size_t i = 0; i < FakeEGL::swapBuffersCallbacks.size(); i++) {
             FakeEGL::swapBuffersCallbacks[i].callback(FakeEGL::swapBuffersCallbacks[i].user, display, surface);
@@ -119,9 +128,21 @@ EGLBoolean eglSwapBuffers(EGLDisplay display, EGLSurface surface) {
     }
     //    Log::trace("FakeEGL", "eglSwapBuffers");
 #ifdef USE_IMGUI
+    GpuTimer::endFrame();
+    // The readback for captures is neither game nor overlay time
+    {
+        int w, h;
+        ((GameWindow *)surface)->getWindowSize(w, h);
+        FrameCapture::onFrame(w, h - Settings::menubarsize);
+    }
+    GpuTimer::beginOverlay();
     ImGuiUIDrawFrame((GameWindow *)surface);
+    GpuTimer::endOverlay();
 #endif
     ((GameWindow *)surface)->swapBuffers();
+#ifdef USE_IMGUI
+    GpuTimer::onSwapBuffersDone();
+#endif
     return EGL_TRUE;
 }
 
@@ -142,7 +163,7 @@ EGLBoolean eglQuerySurface(EGLDisplay display, EGLSurface surface, EGLint attrib
 }
 
 void *eglGetProcAddress(const char *name) {
-    auto it = hostProcOverrides.find(name);
+    auto it = hostProcOverrides.find(std::string_view(name));
     if(it != hostProcOverrides.end())
         return it->second;
     return hostProcAddrFn(name);
@@ -163,29 +184,30 @@ void FakeEGL::addSwapBuffersCallback(void *user, void (*callback)(void *user, EG
 }
 
 void FakeEGL::installLibrary() {
-    std::unordered_map<std::string, void *> syms;
-    syms["eglInitialize"] = (void *)fake_egl::eglInitialize;
-    syms["eglTerminate"] = (void *)fake_egl::eglTerminate;
-    syms["eglGetError"] = (void *)fake_egl::eglGetError;
-    syms["eglQueryString"] = (void *)fake_egl::eglQueryString;
-    syms["eglGetDisplay"] = (void *)fake_egl::eglGetDisplay;
-    syms["eglGetCurrentDisplay"] = (void *)fake_egl::eglGetCurrentDisplay;
-    syms["eglGetCurrentContext"] = (void *)fake_egl::eglGetCurrentContext;
-    syms["eglChooseConfig"] = (void *)fake_egl::eglChooseConfig;
-    syms["eglGetConfigAttrib"] = (void *)fake_egl::eglGetConfigAttrib;
-    syms["eglCreateWindowSurface"] = (void *)fake_egl::eglCreateWindowSurface;
-    syms["eglDestroySurface"] = (void *)fake_egl::eglDestroySurface;
-    syms["eglCreateContext"] = (void *)fake_egl::eglCreateContext;
-    syms["eglDestroyContext"] = (void *)fake_egl::eglDestroyContext;
-    syms["eglMakeCurrent"] = (void *)fake_egl::eglMakeCurrent;
-    syms["eglSwapBuffers"] = (void *)fake_egl::eglSwapBuffers;
-    syms["eglSwapInterval"] = (void *)fake_egl::eglSwapInterval;
-    syms["eglQuerySurface"] = (void *)fake_egl::eglQuerySurface;
-    syms["eglGetProcAddress"] = (void *)fake_egl::eglGetProcAddress;
-    syms["eglWaitClient"] = (void *)+[]() -> EGLBoolean {
-        return EGL_TRUE;
+    static const std::pair<const char *, void *> eglSymbols[] = {
+        {"eglInitialize", (void *)fake_egl::eglInitialize},
+        {"eglTerminate", (void *)fake_egl::eglTerminate},
+        {"eglGetError", (void *)fake_egl::eglGetError},
+        {"eglQueryString", (void *)fake_egl::eglQueryString},
+        {"eglGetDisplay", (void *)fake_egl::eglGetDisplay},
+        {"eglGetCurrentDisplay", (void *)fake_egl::eglGetCurrentDisplay},
+        {"eglGetCurrentContext", (void *)fake_egl::eglGetCurrentContext},
+        {"eglChooseConfig", (void *)fake_egl::eglChooseConfig},
+        {"eglGetConfigAttrib", (void *)fake_egl::eglGetConfigAttrib},
+        {"eglCreateWindowSurface", (void *)fake_egl::eglCreateWindowSurface},
+        {"eglDestroySurface", (void *)fake_egl::eglDestroySurface},
+        {"eglCreateContext", (void *)fake_egl::eglCreateContext},
+        {"eglDestroyContext", (void *)fake_egl::eglDestroyContext},
+        {"eglMakeCurrent", (void *)fake_egl::eglMakeCurrent},
+        {"eglSwapBuffers", (void *)fake_egl::eglSwapBuffers},
+        {"eglSwapInterval", (void *)fake_egl::eglSwapInterval},
+        {"eglQuerySurface", (void *)fake_egl::eglQuerySurface},
+        {"eglGetProcAddress", (void *)fake_egl::eglGetProcAddress},
+        {"eglWaitClient", (void *)+[]() -> EGLBoolean {
+             return EGL_TRUE;
+         }},
     };
-    linker::load_library("libEGL.so", syms);
+    linker::load_library("libEGL.so", HookTable::merge({eglSymbols}));
 }
 
 void FakeEGL::setupGLOverrides() {
@@ -23,61 +23,62 @@ static float _AMotionEvent_getAxisValue(const AInputEvent *event, int32_t axis,
 }
 
 
-void FakeInputQueue::initHybrisHooks(std::unordered_map<std::string, void *> &syms) {
-    syms["AInputQueue_getEvent"] = (void *)+[](AInputQueue *queue, AInputEvent **outEvent) {
-        return ((FakeInputQueue *)(void *)queue)->getEvent((FakeInputEvent **)(void **)outEvent);
+HookTable FakeInputQueue::getHybrisHooks() {
+    static const std::pair<const char *, void *> hooks[] = {
+        {"AInputQueue_getEvent", (void *)+[](AInputQueue *queue, AInputEvent **outEvent) {
+             return ((FakeInputQueue *)(void *)queue)->getEvent((FakeInputEvent **)(void **)outEvent);
+         }},
+        {"AInputQueue_finishEvent", (void *)+[](AInputQueue *queue, AInputEvent *event, int handled) {
+             ((FakeInputQueue *)(void *)queue)->finishEvent((FakeInputEvent *)(void *)event);
+         }},
+        {"AInputQueue_preDispatchEvent", (void *)+[]() {
+             return 0;
+         }},
+        {"AInputEvent_getSource", (void *)+[](const AInputEvent *event) {
+             return ((const FakeInputEvent *)(const void *)event)->source;
+         }},
+        {"AInputEvent_getType", (void *)+[](const AInputEvent *event) {
+             return ((const FakeInputEvent *)(const void *)event)->type;
+         }},
+        {"AInputEvent_getDeviceId", (void *)+[](const AInputEvent *event) {
+             return ((const FakeInputEvent *)(const void *)event)->deviceId;
+         }},
+        {"AKeyEvent_getAction", (void *)+[](const AInputEvent *event) {
+             return ((const FakeKeyEvent *)(const void *)event)->action;
+         }},
+        {"AKeyEvent_getKeyCode", (void *)+[](const AInputEvent *event) {
+             return ((const FakeKeyEvent *)(const void *)event)->keyCode;
+         }},
+        {"AKeyEvent_getRepeatCount", (void *)+[](const AInputEvent *event) {
+             return (int32_t)0;
+         }},
+        {"AKeyEvent_getMetaState", (void *)+[](const AInputEvent *event) {
+             return ((const FakeKeyEvent *)(const void *)event)->metaState;
+         }},
+        {"AMotionEvent_getAction", (void *)+[](const AInputEvent *event) {
+             return ((const FakeMotionEvent *)(const void *)event)->action;
+         }},
+        {"AMotionEvent_getPointerCount", (void *)+[](const AInputEvent *event) {
+             return 1;
+         }},
+        {"AMotionEvent_getButtonState", (void *)+[](const AInputEvent *event) {
+             if(((const FakeMotionEvent *)(const void *)event)->btn)
+                 return ((const FakeMotionEvent *)(const void *)event)->btn;
+             return 0;
+         }},
+        {"AMotionEvent_getPointerId", (void *)+[](const AInputEvent *event) {
+             return ((const FakeMotionEvent *)(const void *)event)->pointerId;
+         }},
+        {"AMotionEvent_getHistorySize", (void *)+[](const AInputEvent *event) {
+             return 0;
+         }},
+        {"AMotionEvent_getX", reinterpret_cast<void *>(ARMHFREWRITE(_AMotionEvent_getX))},
+        {"AMotionEvent_getY", reinterpret_cast<void *>(ARMHFREWRITE(_AMotionEvent_getY))},
+        {"AMotionEvent_getRawX", reinterpret_cast<void *>(ARMHFREWRITE(_AMotionEvent_getX))},
+        {"AMotionEvent_getRawY", reinterpret_cast<void *>(ARMHFREWRITE(_AMotionEvent_getY))},
+        {"AMotionEvent_getAxisValue", reinterpret_cast<void *>(ARMHFREWRITE(_AMotionEvent_getAxisValue))},
     };
-    syms["AInputQueue_finishEvent"] = (void *)+[](AInputQueue *queue, AInputEvent *event, int handled) {
-        ((FakeInputQueue *)(void *)queue)->finishEvent((FakeInputEvent *)(void *)event);
-    };
-    syms["AInputQueue_preDispatchEvent"] = (void *)+[]() {
-        return 0;
-    };
-    syms["AInputEvent_getSource"] = (void *)+[](const AInputEvent *event) {
-        return ((const FakeInputEvent *)(const void *)event)->source;
-    };
-    syms["AInputEvent_getType"] = (void *)+[](const AInputEvent *event) {
-        return ((const FakeInputEvent *)(const void *)event)->type;
-    };
-    syms["AInputEvent_getDeviceId"] = (void *)+[](const AInputEvent *event) {
-        return ((const FakeInputEvent *)(const void *)event)->deviceId;
-    };
-    syms["AKeyEvent_getAction"] = (void *)+[](const AInputEvent *event) {
-        return ((const FakeKeyEvent *)(const void *)event)->action;
-    };
-    syms["AKeyEvent_getKeyCode"] = (void *)+[](const AInputEvent *event) {
-        return ((const FakeKeyEvent *)(const void *)event)->keyCode;
-    };
-    syms["AKeyEvent_getRepeatCount"] = (void *)+[](const AInputEvent *event) {
-        return (int32_t)0;
-    };
-    syms["AKeyEvent_getMetaState"] = (void *)+[](const AInputEvent *event) {
-        return ((const FakeKeyEvent *)(const void *)event)->metaState;
-    };
-    syms["AMotionEvent_getAction"] = (void *)+[](const AInputEvent *event) {
-        return ((const FakeMotionEvent *)(const void *)event)->action;
-    };
-    syms["AMotionEvent_getPointerCount"] = (void *)+[](const AInputEvent *event) {
-        return 1;
-    };
-    syms["AMotionEvent_getButtonState"] = (void *)+[](const AInputEvent *event) {
-        if(((const FakeMotionEvent *)(const void *)event)->btn)
-            return ((const FakeMotionEvent *)(const void *)event)->btn;
-        return 0;
-    };
-    syms["AMotionEvent_getPointerId"] = (void *)+[](const AInputEvent *event) {
-        return ((const FakeMotionEvent *)(const void *)event)->pointerId;
-    };
-    
-    syms["AMotionEvent_getHistorySize"] = (void *)+[](const AInputEvent *event) {
-        return 0;
-    };
-
-    syms["AMotionEvent_getX"] = reinterpret_cast<void *>(ARMHFREWRITE(_AMotionEvent_getX));
-    syms["AMotionEvent_getY"] = reinterpret_cast<void *>(ARMHFREWRITE(_AMotionEvent_getY));
-    syms["AMotionEvent_getRawX"] = reinterpret_cast<void *>(ARMHFREWRITE(_AMotionEvent_getX));
-    syms["AMotionEvent_getRawY"] = reinterpret_cast<void *>(ARMHFREWRITE(_AMotionEvent_getY));
-    syms["AMotionEvent_getAxisValue"] = reinterpret_cast<void *>(ARMHFREWRITE(_AMotionEvent_getAxisValue));
+    return hooks;
 }
 
 int FakeInputQueue::getEvent(FakeInputEvent **event) {
@@ -5,6 +5,7 @@
 #include <functional>
 #include <string>
 #include <unordered_map>
+#include "hook_table.h"
 
 struct FakeInputEvent {
     int32_t source, type;
@@ -43,7 +44,7 @@ private:
     std::deque<FakeMotionEvent> motionEvents;
 
 public:
-    static void initHybrisHooks(std::unordered_map<std::string, void *> &syms);
+    static HookTable getHybrisHooks();
 
     FakeInputQueue() {
         // Should avoid a crash caused by a lot of events from gamepad's analog sticks
@@ -24,33 +24,35 @@ void FakeLooper::initWindow() {
     currentLooper->initializeWindow();
 }
 
-void FakeLooper::initHybrisHooks(std::unordered_map<std::string, void *> &syms) {
-    syms["ALooper_prepare"] = (void *)+[]() {
-        if(currentLooper && currentLooper->prepared)
-            throw std::runtime_error("Looper already prepared");
-        if(!currentLooper) {
-            currentLooper = std::make_unique<FakeLooper>();
-        }
-        currentLooper->prepared = true;
-
-        currentLooper->prepare();
-        return (ALooper *)(void *)currentLooper.get();
-    };
-    syms["ALooper_addFd"] = (void *)+[](ALooper *looper, int fd, int ident, int events, ALooper_callbackFunc callback, void *data) {
-        return ((FakeLooper *)(void *)looper)->addFd(fd, ident, events, callback, data);
-    };
-    syms["ALooper_pollAll"] = (void *)+[](int timeoutMillis, int *outFd, int *outEvents, void **outData) {
-        return currentLooper->pollAll(timeoutMillis, outFd, outEvents, outData);
-    };
-    syms["AInputQueue_attachLooper"] = (void *)+[](AInputQueue *queue, ALooper *looper, int ident, ALooper_callbackFunc callback, void *data) {
-        ((FakeLooper *)(void *)looper)->attachInputQueue(ident, callback, data);
-    };
-
-    syms["ANativeActivity_finish"] = (void *)+[](ANativeActivity *native) {
-        FakeJni::JniEnvContext ctx(*(FakeJni::Jvm *)native->vm);
-        auto activity = std::dynamic_pointer_cast<MainActivity>(ctx.getJniEnv().resolveReference(native->clazz));
-        activity->quitCallback();
+HookTable FakeLooper::getHybrisHooks() {
+    static const std::pair<const char *, void *> hooks[] = {
+        {"ALooper_prepare", (void *)+[]() {
+             if(currentLooper && currentLooper->prepared)
+                 throw std::runtime_error("Looper already prepared");
+             if(!currentLooper) {
+                 currentLooper = std::make_unique<FakeLooper>();
+             }
+             currentLooper->prepared = true;
+
+             currentLooper->prepare();
+             return (ALooper *)(void *)currentLooper.get();
+         }},
+        {"ALooper_addFd", (void *)+[](ALooper *looper, int fd, int ident, int events, ALooper_callbackFunc callback, void *data) {
+             return ((FakeLooper *)(void *)looper)->addFd(fd, ident, events, callback, data);
+         }},
+        {"ALooper_pollAll", (void *)+[](int timeoutMillis, int *outFd, int *outEvents, void **outData) {
+             return currentLooper->pollAll(timeoutMillis, outFd, outEvents, outData);
+         }},
+        {"AInputQueue_attachLooper", (void *)+[](AInputQueue *queue, ALooper *looper, int ident, ALooper_callbackFunc callback, void *data) {
+             ((FakeLooper *)(void *)looper)->attachInputQueue(ident, callback, data);
+         }},
+        {"ANativeActivity_finish", (void *)+[](ANativeActivity *native) {
+             FakeJni::JniEnvContext ctx(*(FakeJni::Jvm *)native->vm);
+             auto activity = std::dynamic_pointer_cast<MainActivity>(ctx.getJniEnv().resolveReference(native->clazz));
+             activity->quitCallback();
+         }},
     };
+    return hooks;
 }
 
 void FakeLooper::onGameActivityClose(GameActivity *native) {
@@ -64,10 +66,14 @@ void FakeLooper::initializeWindow() {
     if(associatedWindow) {
         return;
     }
-    Log::info("Launcher", "Loading gamepad mappings");
-    WindowCallbacks::loadGamepadMappings();
+    if(!options.headless) {
+        Log::info("Launcher", "Loading gamepad mappings");
+        WindowCallbacks::loadGamepadMappings();
+    }
 #ifdef MCPELAUNCHER_ENABLE_ERROR_WINDOW
-    GameWindowManager::getManager()->setErrorHandler(std::make_shared<ErrorWindow>());
+    if(!options.headless) {
+        GameWindowManager::getManager()->setErrorHandler(std::make_shared<ErrorWindow>());
+    }
 #endif
 
     Log::info("Launcher", "Creating window");
@@ -6,6 +6,7 @@
 #include "jni/jni_support.h"
 #include "window_callbacks.h"
 #include "fake_inputqueue.h"
+#include "hook_table.h"
 
 class FakeLooper {
 private:
@@ -59,7 +60,7 @@ public:
 
     static void initWindow();
 
-    static void initHybrisHooks(std::unordered_map<std::string, void *> &syms);
+    static HookTable getHybrisHooks();
 
     static void onGameActivityClose(GameActivity *native);
 };
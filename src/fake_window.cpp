@@ -2,15 +2,18 @@
 #include "settings.h"
 #include <game_window.h>
 
-void FakeWindow::initHybrisHooks(std::unordered_map<std::string, void*>& syms) {
-    syms["ANativeWindow_getWidth"] = (void*)+[](void* window) -> int32_t {
-        int width, height;
-        ((GameWindow*)window)->getWindowSize(width, height);
-        return width;
-    };
-    syms["ANativeWindow_getHeight"] = (void*)+[](void* window) -> int32_t {
-        int width, height;
-        ((GameWindow*)window)->getWindowSize(width, height);
-        return height - Settings::menubarsize;
+HookTable FakeWindow::getHybrisHooks() {
+    static const std::pair<const char*, void*> hooks[] = {
+        {"ANativeWindow_getWidth", (void*)+[](void* window) -> int32_t {
+             int width, height;
+             ((GameWindow*)window)->getWindowSize(width, height);
+             return width;
+         }},
+        {"ANativeWindow_getHeight", (void*)+[](void* window) -> int32_t {
+             int width, height;
+             ((GameWindow*)window)->getWindowSize(width, height);
+             return height - Settings::menubarsize;
+         }},
     };
+    return hooks;
 }
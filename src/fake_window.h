@@ -1,8 +1,9 @@
 #pragma once
 #include <string>
 #include <unordered_map>
+#include "hook_table.h"
 
 class FakeWindow {
 public:
-    static void initHybrisHooks(std::unordered_map<std::string, void *> &syms);
+    static HookTable getHybrisHooks();
 };
@@ -0,0 +1,241 @@
+#include "file_transfer.h"
+#include <log.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+
+static const size_t chunkSize = 16 * 1024 * 1024;
+static const uint64_t progressMinSize = 64 * 1024 * 1024;
+static const size_t maxWorkers = 4;
+
+namespace {
+class ProgressLog {
+    const std::string &path;
+    uint64_t total;
+    int lastStep = 0;
+
+public:
+    ProgressLog(const std::string &path, uint64_t total) : path(path), total(total) {}
+
+    void update(uint64_t copied) {
+        if(total < progressMinSize) {
+            return;
+        }
+        int step = (int)(copied * 10 / total);
+        if(step > lastStep) {
+            lastStep = step;
+            Log::info("FileTransfer", "Copying %s: %d%%", path.c_str(), step * 10);
+        }
+    }
+};
+}  // namespace
+
+static bool copyReadWrite(int in, int out, uint64_t size, uint64_t &copied, ProgressLog &progress) {
+    std::vector<char> buffer(std::min<uint64_t>(chunkSize, std::max<uint64_t>(size, 1)));
+    while(copied < size) {
+        ssize_t n = pread(in, buffer.data(), std::min<uint64_t>(buffer.size(), size - copied), copied);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0) {
+            return false;
+        }
+        if(n == 0) {
+            // The source was truncated while copying
+            break;
+        }
+        for(ssize_t written = 0; written < n;) {
+            ssize_t w = write(out, buffer.data() + written, n - written);
+            if(w < 0 && errno == EINTR) {
+                continue;
+            }
+            if(w <= 0) {
+                return false;
+            }
+            written += w;
+        }
+        copied += n;
+        progress.update(copied);
+    }
+    return true;
+}
+
+static bool copyContents(int in, int out, uint64_t size, ProgressLog &progress, FileTransfer::Method &method) {
+    uint64_t copied = 0;
+#ifdef __linux__
+#ifdef FICLONE
+    if(ioctl(out, FICLONE, in) == 0) {
+        method = FileTransfer::Method::Reflink;
+        return true;
+    }
+#endif
+    // Copies inside the kernel, also server side on nfs and smb, fails on older kernels or across filesystems
+    method = FileTransfer::Method::CopyFileRange;
+    while(copied < size) {
+        ssize_t n = copy_file_range(in, nullptr, out, nullptr, std::min<uint64_t>(chunkSize, size - copied), 0);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            break;
+        }
+        copied += n;
+        progress.update(copied);
+    }
+    if(copied < size) {
+        method = FileTransfer::Method::Sendfile;
+        off_t offset = copied;
+        lseek(out, copied, SEEK_SET);
+        while(copied < size) {
+            ssize_t n = sendfile(out, in, &offset, std::min<uint64_t>(chunkSize, size - copied));
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            if(n <= 0) {
+                break;
+            }
+            copied += n;
+            progress.update(copied);
+        }
+    }
+    if(copied >= size) {
+        return true;
+    }
+    lseek(out, copied, SEEK_SET);
+#endif
+    method = FileTransfer::Method::ReadWrite;
+    return copyReadWrite(in, out, size, copied, progress);
+}
+
+bool FileTransfer::copy(const std::string &src, const std::string &dst, bool allowHardlink, Method *method) {
+    auto start = std::chrono::steady_clock::now();
+    struct stat srcStat, dstStat;
+    if(stat(src.c_str(), &srcStat) != 0 || !S_ISREG(srcStat.st_mode)) {
+        Log::error("FileTransfer", "Cannot copy %s: not a regular file", src.c_str());
+        return false;
+    }
+    if(stat(dst.c_str(), &dstStat) == 0 && dstStat.st_dev == srcStat.st_dev && dstStat.st_ino == srcStat.st_ino) {
+        return true;
+    }
+    Method used = Method::Hardlink;
+    bool ok = false;
+    if(allowHardlink) {
+        unlink(dst.c_str());
+        ok = link(src.c_str(), dst.c_str()) == 0;
+    }
+    if(!ok) {
+        int in = open(src.c_str(), O_RDONLY | O_CLOEXEC);
+        if(in == -1) {
+            Log::error("FileTransfer", "Cannot open %s: %s", src.c_str(), strerror(errno));
+            return false;
+        }
+        int out = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(out == -1) {
+            Log::error("FileTransfer", "Cannot create %s: %s", dst.c_str(), strerror(errno));
+            close(in);
+            return false;
+        }
+        ProgressLog progress(src, srcStat.st_size);
+        ok = copyContents(in, out, srcStat.st_size, progress, used);
+        if(!ok) {
+            Log::error("FileTransfer", "Failed to copy %s to %s: %s", src.c_str(), dst.c_str(), strerror(errno));
+        }
+        close(in);
+        if(close(out) != 0) {
+            ok = false;
+        }
+        if(!ok) {
+            unlink(dst.c_str());
+            return false;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Log::info("FileTransfer", "Copied %s to %s using %s in %.2f s (%.0f MB/s)", src.c_str(), dst.c_str(), methodName(used), seconds, seconds > 0 ? srcStat.st_size / seconds / 1024 / 1024 : 0);
+    if(method) {
+        *method = used;
+    }
+    return true;
+}
+
+namespace {
+struct WorkerPool {
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> jobs;
+    size_t workers = 0;
+    size_t idleWorkers = 0;
+    // Queued or running jobs
+    size_t pending = 0;
+    std::condition_variable finished;
+};
+}  // namespace
+// Never destroyed, the detached workers are still waiting on it during exit
+static WorkerPool &pool = *new WorkerPool;
+
+static void workerLoop() {
+    std::unique_lock<std::mutex> lock(pool.lock);
+    while(true) {
+        pool.idleWorkers++;
+        pool.cv.wait(lock, []() { return !pool.jobs.empty(); });
+        pool.idleWorkers--;
+        auto job = std::move(pool.jobs.front());
+        pool.jobs.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+        pool.pending--;
+        pool.finished.notify_all();
+    }
+}
+
+void FileTransfer::copyAsync(std::string src, std::string dst, bool allowHardlink, std::function<void(bool ok)> done) {
+    std::lock_guard<std::mutex> lock(pool.lock);
+    pool.jobs.emplace_back([src = std::move(src), dst = std::move(dst), allowHardlink, done = std::move(done)]() {
+        done(copy(src, dst, allowHardlink));
+    });
+    pool.pending++;
+    if(pool.idleWorkers == 0 && pool.workers < maxWorkers) {
+        pool.workers++;
+        std::thread(workerLoop).detach();
+    }
+    pool.cv.notify_one();
+}
+
+void FileTransfer::waitForPending() {
+    std::unique_lock<std::mutex> lock(pool.lock);
+    if(pool.pending) {
+        // Stopping now would leave a truncated file at the destination
+        Log::info("FileTransfer", "Waiting for %zu file transfers to finish", pool.pending);
+        pool.finished.wait(lock, []() { return pool.pending == 0; });
+    }
+}
+
+const char *FileTransfer::methodName(Method method) {
+    switch(method) {
+    case Method::Hardlink:
+        return "hardlink";
+    case Method::Reflink:
+        return "reflink";
+    case Method::CopyFileRange:
+        return "copy_file_range";
+    case Method::Sendfile:
+        return "sendfile";
+    case Method::ReadWrite:
+        return "read/write";
+    }
+    return "unknown";
+}
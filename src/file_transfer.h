@@ -0,0 +1,23 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+// Copies imported and exported files on a small worker pool, using the cheapest method the filesystems allow
+struct FileTransfer {
+    enum class Method {
+        Hardlink,
+        Reflink,
+        CopyFileRange,
+        Sendfile,
+        ReadWrite
+    };
+
+    // Hardlinks are only used if allowHardlink is set, the destination then shares its contents with the source
+    static bool copy(const std::string &src, const std::string &dst, bool allowHardlink, Method *method = nullptr);
+    // Runs copy on a worker thread, done is called on that thread, transfers of large files log their progress
+    static void copyAsync(std::string src, std::string dst, bool allowHardlink, std::function<void(bool ok)> done);
+    // Blocks until every queued copy and its done callback finished, called before the process exits
+    static void waitForPending();
+    static const char *methodName(Method method);
+};
@@ -0,0 +1,453 @@
+#include "frame_capture.h"
+#include "frame_stats.h"
+
+#include <GLES3/gl3.h>
+#include <mcpelauncher/path_helper.h>
+#include <FileUtil.h>
+#include <log.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Readbacks are mapped a couple of frames later and stay mapped until the worker encoded them, so the render thread
+// neither waits on glReadPixels nor copies the pixels. Sequence frames are dropped while every buffer is busy
+static constexpr int kPboCount = 4;
+
+enum CaptureKind {
+    CAPTURE_SCREENSHOT = 1,
+    CAPTURE_SEQUENCE = 2,
+    CAPTURE_SEQUENCE_END = 4,
+};
+
+struct CaptureJob {
+    int kinds;
+    int width;
+    int height;
+    int sequenceId;
+    int sequenceInterval;
+    // Rendered frames per second times 1000
+    int frameRate;
+    // Mapped pixel buffer of slot, handed back to the render thread once the job is written
+    const uint8_t* pixels;
+    int slot;
+};
+
+struct PboSlot {
+    GLuint pbo = 0;
+    GLsync fence = nullptr;
+    size_t capacity = 0;
+    int width = 0;
+    int height = 0;
+    int kinds = 0;
+    int sequenceId = 0;
+    int sequenceInterval = 0;
+    int frameRate = 0;
+    // Mapped while its job is queued, the worker sets released and the render thread unmaps it
+    bool mapped = false;
+    std::atomic_bool released{false};
+};
+
+static std::atomic_bool screenshotRequested;
+static std::atomic_int sequenceInterval;
+static std::atomic_int sequenceId;
+// Sequence whose end marker waits for its frames still in flight on the GPU
+static std::atomic_int endingSequence;
+static std::atomic_int droppedFrames;
+
+static bool initialized = false;
+static bool supported = false;
+static PboSlot slots[kPboCount];
+static unsigned int sequenceFrame = 0;
+
+static std::mutex jobsLock;
+static std::condition_variable jobsCv;
+static std::deque<CaptureJob> jobs;
+static bool workerStarted = false;
+// Queued plus the one being written
+static int pendingJobs = 0;
+static std::condition_variable jobsDoneCv;
+
+static std::string timestamp() {
+    char buf[32];
+    time_t t = time(nullptr);
+    strftime(buf, sizeof(buf), "%Y%m%d-%H%M%S", localtime(&t));
+    return buf;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t length) {
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if(!tableReady) {
+        for(uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for(int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+    crc = ~crc;
+    for(size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void putBE32(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+static void writeChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> chunk;
+    chunk.reserve(data.size() + 12);
+    putBE32(chunk, data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putBE32(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+    file.write((const char*)chunk.data(), chunk.size());
+}
+
+// Screenshots are rare, so the png uses stored deflate blocks instead of pulling in a compression library
+static bool writePng(const std::string& path, const CaptureJob& job) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if(!file) {
+        return false;
+    }
+    static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    file.write((const char*)signature, sizeof(signature));
+
+    std::vector<uint8_t> header;
+    putBE32(header, job.width);
+    putBE32(header, job.height);
+    header.insert(header.end(), {8 /* bit depth */, 2 /* rgb */, 0, 0, 0});
+    writeChunk(file, "IHDR", header);
+
+    // GL rows are bottom up, filter type 0 per row and alpha dropped
+    size_t rowLength = (size_t)job.width * 3 + 1;
+    std::vector<uint8_t> raw(rowLength * job.height);
+    for(int y = 0; y < job.height; y++) {
+        auto src = job.pixels + (size_t)(job.height - 1 - y) * job.width * 4;
+        auto dst = raw.data() + y * rowLength;
+        *dst++ = 0;
+        for(int x = 0; x < job.width; x++, src += 4) {
+            *dst++ = src[0];
+            *dst++ = src[1];
+            *dst++ = src[2];
+        }
+    }
+
+    std::vector<uint8_t> idat;
+    idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    idat.push_back(0x78);
+    idat.push_back(0x01);
+    uint32_t a = 1, b = 0;
+    for(size_t offset = 0;;) {
+        size_t length = std::min<size_t>(raw.size() - offset, 65535);
+        bool last = offset + length == raw.size();
+        idat.push_back(last ? 1 : 0);
+        idat.push_back(length & 0xFF);
+        idat.push_back(length >> 8);
+        idat.push_back(~length & 0xFF);
+        idat.push_back((~length >> 8) & 0xFF);
+        idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + length);
+        for(size_t i = offset; i < offset + length; i++) {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        offset += length;
+        if(last) {
+            break;
+        }
+    }
+    putBE32(idat, (b << 16) | a);
+    writeChunk(file, "IDAT", idat);
+    writeChunk(file, "IEND", {});
+    return (bool)file;
+}
+
+// Full range BT.601 with 2x2 averaged chroma, matching the C420jpeg tag
+static void writeY4mFrame(std::ofstream& file, const CaptureJob& job, int width, int height) {
+    std::vector<uint8_t> planes((size_t)width * height * 3 / 2);
+    auto yPlane = planes.data();
+    auto uPlane = yPlane + (size_t)width * height;
+    auto vPlane = uPlane + (size_t)width * height / 4;
+    auto pixel = [&](int x, int y) {
+        return job.pixels + ((size_t)(job.height - 1 - y) * job.width + x) * 4;
+    };
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            auto p = pixel(x, y);
+            yPlane[(size_t)y * width + x] = (uint8_t)((77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8);
+        }
+    }
+    for(int y = 0; y < height; y += 2) {
+        for(int x = 0; x < width; x += 2) {
+            int r = 0, g = 0, b = 0;
+            for(int i = 0; i < 4; i++) {
+                auto p = pixel(x + (i & 1), y + (i >> 1));
+                r += p[0];
+                g += p[1];
+                b += p[2];
+            }
+            r /= 4;
+            g /= 4;
+            b /= 4;
+            size_t index = (size_t)(y / 2) * (width / 2) + x / 2;
+            uPlane[index] = (uint8_t)((-43 * r - 85 * g + 128 * b + 32768) >> 8);
+            vPlane[index] = (uint8_t)((128 * r - 107 * g - 21 * b + 32768) >> 8);
+        }
+    }
+    file << "FRAME\n";
+    file.write((const char*)planes.data(), planes.size());
+}
+
+static void workerMain() {
+    std::ofstream sequenceFile;
+    int openSequence = 0;
+    int closedSequence = 0;
+    int sequenceWidth = 0;
+    int sequenceHeight = 0;
+    int screenshotIndex = 0;
+    while(true) {
+        CaptureJob job;
+        {
+            std::unique_lock<std::mutex> lock(jobsLock);
+            jobsCv.wait(lock, [] { return !jobs.empty(); });
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        auto dir = FrameCapture::getCaptureDirectory();
+        if(job.kinds & CAPTURE_SCREENSHOT) {
+            auto path = dir + "screenshot-" + timestamp() + "-" + std::to_string(screenshotIndex++) + ".png";
+            if(writePng(path, job)) {
+                Log::info("FrameCapture", "Saved screenshot to %s", path.data());
+            } else {
+                Log::error("FrameCapture", "Failed to save screenshot to %s", path.data());
+            }
+        }
+        if((job.kinds & CAPTURE_SEQUENCE) && job.sequenceId > closedSequence) {
+            // y4m has a fixed frame size, a resize starts a new file
+            int width = job.width & ~1;
+            int height = job.height & ~1;
+            if(job.sequenceId != openSequence || width != sequenceWidth || height != sequenceHeight) {
+                sequenceFile.close();
+                auto path = dir + "frames-" + timestamp() + ".y4m";
+                sequenceFile.open(path, std::ios::binary | std::ios::trunc);
+                sequenceFile << "YUV4MPEG2 W" << width << " H" << height << " F" << job.frameRate << ":" << job.sequenceInterval * 1000 << " Ip A1:1 C420jpeg\n";
+                openSequence = job.sequenceId;
+                sequenceWidth = width;
+                sequenceHeight = height;
+                Log::info("FrameCapture", "Recording frames to %s", path.data());
+            }
+            writeY4mFrame(sequenceFile, job, width, height);
+        }
+        if(job.kinds & CAPTURE_SEQUENCE_END) {
+            closedSequence = job.sequenceId;
+            if(openSequence == job.sequenceId) {
+                sequenceFile.close();
+            }
+            if(int dropped = droppedFrames.exchange(0)) {
+                Log::warn("FrameCapture", "Dropped %d frames, the encoder could not keep up", dropped);
+            }
+        }
+        if(job.slot >= 0) {
+            slots[job.slot].released = true;
+        }
+        std::lock_guard<std::mutex> lock(jobsLock);
+        pendingJobs--;
+        jobsDoneCv.notify_all();
+    }
+}
+
+static void pushJob(CaptureJob&& job) {
+    std::lock_guard<std::mutex> lock(jobsLock);
+    if(!workerStarted) {
+        FileUtil::mkdirRecursive(FrameCapture::getCaptureDirectory());
+        std::thread(workerMain).detach();
+        workerStarted = true;
+    }
+    jobs.emplace_back(std::move(job));
+    pendingJobs++;
+    jobsCv.notify_one();
+}
+
+void FrameCapture::requestScreenshot() {
+    screenshotRequested = true;
+}
+
+void FrameCapture::startSequence(int everyNthFrame) {
+    sequenceId++;
+    sequenceInterval = everyNthFrame;
+}
+
+void FrameCapture::stopSequence() {
+    // The end marker is queued by onFrame once the readbacks of this sequence are collected
+    if(sequenceInterval.exchange(0)) {
+        endingSequence = sequenceId.load();
+    }
+}
+
+static void pushSequenceEnd() {
+    if(int id = endingSequence.exchange(0)) {
+        pushJob(CaptureJob{.kinds = CAPTURE_SEQUENCE_END, .sequenceId = id, .pixels = nullptr, .slot = -1});
+    }
+}
+
+void FrameCapture::flush() {
+    stopSequence();
+    // Frames still on the GPU are lost, the render thread may already be gone
+    pushSequenceEnd();
+    std::unique_lock<std::mutex> lock(jobsLock);
+    if(!jobsDoneCv.wait_for(lock, std::chrono::seconds(10), [] { return pendingJobs == 0; })) {
+        Log::warn("FrameCapture", "%d captures were still being written on exit", pendingJobs);
+    }
+}
+
+int FrameCapture::getSequenceInterval() {
+    return sequenceInterval;
+}
+
+std::string FrameCapture::getCaptureDirectory() {
+    return PathHelper::getPrimaryDataDirectory() + "screenshots/";
+}
+
+// Averaged over the recent frames, y4m players use it as the playback speed
+static int measureFrameRate() {
+    float frames[120];
+    size_t count = FrameStats::snapshot(frames, 120);
+    double sum = 0;
+    for(size_t i = 0; i < count; i++) {
+        sum += frames[i];
+    }
+    return sum > 0 ? (int)std::lround(count * 1000000.0 / sum) : 60000;
+}
+
+static void collectFinished() {
+    for(auto&& slot : slots) {
+        if(slot.mapped && slot.released.exchange(false)) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            slot.mapped = false;
+        }
+        if(!slot.fence) {
+            continue;
+        }
+        auto status = glClientWaitSync(slot.fence, 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            continue;
+        }
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        size_t size = (size_t)slot.width * slot.height * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        auto data = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if(data) {
+            slot.mapped = true;
+            pushJob(CaptureJob{.kinds = slot.kinds, .width = slot.width, .height = slot.height, .sequenceId = slot.sequenceId, .sequenceInterval = slot.sequenceInterval, .frameRate = slot.frameRate, .pixels = data, .slot = (int)(&slot - slots)});
+        }
+    }
+}
+
+void FrameCapture::onFrame(int width, int height) {
+    int interval = sequenceInterval;
+    if(!initialized) {
+        if(!screenshotRequested && !interval) {
+            return;
+        }
+        initialized = true;
+        supported = glFenceSync && glClientWaitSync && glMapBufferRange && glGenBuffers;
+        if(!supported) {
+            Log::error("FrameCapture", "Frame capture requires OpenGL ES 3.0");
+            return;
+        }
+        for(auto&& slot : slots) {
+            glGenBuffers(1, &slot.pbo);
+        }
+    }
+    if(!supported || width <= 0 || height <= 0) {
+        screenshotRequested = false;
+        pushSequenceEnd();
+        return;
+    }
+    bool inFlight = false;
+    for(auto&& slot : slots) {
+        inFlight |= slot.fence != nullptr || slot.mapped;
+    }
+    if(!inFlight && !screenshotRequested && !interval) {
+        pushSequenceEnd();
+        return;
+    }
+
+    GLint prevPackBuffer = 0;
+    GLint prevReadFramebuffer = 0;
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &prevPackBuffer);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prevReadFramebuffer);
+
+    collectFinished();
+    if(int ending = endingSequence) {
+        bool pending = false;
+        for(auto&& slot : slots) {
+            pending |= slot.fence && (slot.kinds & CAPTURE_SEQUENCE) && slot.sequenceId <= ending;
+        }
+        // A stop racing in here leaves the newer sequence for a later frame
+        if(!pending && endingSequence.compare_exchange_strong(ending, 0)) {
+            pushJob(CaptureJob{.kinds = CAPTURE_SEQUENCE_END, .sequenceId = ending, .pixels = nullptr, .slot = -1});
+        }
+    }
+
+    int kinds = 0;
+    if(interval && sequenceFrame++ % interval == 0) {
+        kinds |= CAPTURE_SEQUENCE;
+    }
+    if(screenshotRequested) {
+        kinds |= CAPTURE_SCREENSHOT;
+    }
+    PboSlot* slot = nullptr;
+    if(kinds) {
+        for(auto&& s : slots) {
+            if(!s.fence && !s.mapped) {
+                slot = &s;
+                break;
+            }
+        }
+    }
+    // All buffers still in flight: a pending screenshot is retried next frame, sequence frames are skipped
+    if(!slot && (kinds & CAPTURE_SEQUENCE)) {
+        droppedFrames++;
+    }
+    if(slot) {
+        if(kinds & CAPTURE_SCREENSHOT) {
+            screenshotRequested = false;
+        }
+        size_t size = (size_t)width * height * 4;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+        if(slot->capacity < size) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+            slot->capacity = size;
+        }
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot->width = width;
+        slot->height = height;
+        slot->kinds = kinds;
+        slot->sequenceId = sequenceId;
+        slot->sequenceInterval = interval;
+        slot->frameRate = kinds & CAPTURE_SEQUENCE ? measureFrameRate() : 0;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, prevPackBuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, prevReadFramebuffer);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+
+// Screenshots and frame dumps read back through pixel buffer objects, encoding happens on a worker thread
+struct FrameCapture {
+    // Saves the next frame as png
+    static void requestScreenshot();
+    // Appends every nth frame to a y4m file until stopped
+    static void startSequence(int everyNthFrame);
+    static void stopSequence();
+    static int getSequenceInterval();
+    // Ends the recording and waits until the worker wrote everything queued, called before the process exits
+    static void flush();
+
+    // Called from eglSwapBuffers before the overlay is drawn
+    static void onFrame(int width, int height);
+
+    static std::string getCaptureDirectory();
+};
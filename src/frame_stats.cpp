@@ -0,0 +1,115 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+static std::atomic<float> frameTimes[FrameStats::capacity];
+static std::atomic<size_t> frameCount{0};
+static std::chrono::steady_clock::time_point lastFrame;
+
+void FrameStats::recordFrame() {
+    auto now = std::chrono::steady_clock::now();
+    if(lastFrame.time_since_epoch().count()) {
+        auto index = frameCount.load(std::memory_order_relaxed);
+        frameTimes[index % capacity].store(std::chrono::duration<float, std::milli>(now - lastFrame).count(), std::memory_order_relaxed);
+        frameCount.store(index + 1, std::memory_order_release);
+    }
+    lastFrame = now;
+}
+
+size_t FrameStats::snapshot(float* out, size_t max) {
+    auto end = frameCount.load(std::memory_order_acquire);
+    auto count = std::min({max, end, capacity});
+    for(size_t i = 0; i < count; i++) {
+        out[i] = frameTimes[(end - count + i) % capacity].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+// Average fps of the slowest fraction of frames, frames must be sorted descending
+static double lowFps(const std::vector<float>& sorted, double fraction) {
+    size_t n = std::max<size_t>(1, (size_t)(sorted.size() * fraction));
+    double sum = 0;
+    for(size_t i = 0; i < n; i++) {
+        sum += sorted[i];
+    }
+    return sum > 0 ? 1000.0 * n / sum : 0;
+}
+
+FrameStatsSummary FrameStats::summarize(const float* frames, size_t count, float stutterThresholdMs) {
+    FrameStatsSummary summary;
+    if(!count) {
+        return summary;
+    }
+    std::vector<float> sorted(frames, frames + count);
+    std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+    double sum = 0;
+    for(auto&& frame : sorted) {
+        sum += frame;
+        if(frame > stutterThresholdMs) {
+            summary.stutters++;
+        }
+    }
+    summary.count = count;
+    summary.avgMs = sum / count;
+    summary.p99Ms = sorted[count / 100];
+    summary.low1Fps = lowFps(sorted, 0.01);
+    summary.low01Fps = lowFps(sorted, 0.001);
+    return summary;
+}
+
+bool FrameStats::dumpCsv(const std::string& path) {
+    std::vector<float> frames(capacity);
+    frames.resize(snapshot(frames.data(), frames.size()));
+    std::ofstream file(path);
+    if(!file) {
+        return false;
+    }
+    file << "frame,frame_ms\n";
+    for(size_t i = 0; i < frames.size(); i++) {
+        file << i << ',' << frames[i] << '\n';
+    }
+    return (bool)file;
+}
+
+size_t FrameStats::getFrameCount() {
+    return frameCount.load(std::memory_order_acquire);
+}
+
+size_t FrameStats::collect(size_t& next, std::vector<float>& out) {
+    auto end = frameCount.load(std::memory_order_acquire);
+    size_t lost = 0;
+    if(end - std::min(next, end) > capacity) {
+        lost = end - capacity - next;
+        next = end - capacity;
+    }
+    for(; next < end; next++) {
+        out.push_back(frameTimes[next % capacity].load(std::memory_order_relaxed));
+    }
+    return lost;
+}
+
+bool FrameStats::dumpJson(const std::string& path, float stutterThresholdMs, const std::vector<float>& frames, size_t lostFrames) {
+    auto summary = summarize(frames.data(), frames.size(), stutterThresholdMs);
+    nlohmann::json json;
+    json["frames_total"] = frames.size() + lostFrames;
+    json["frames"] = summary.count;
+    json["avg_ms"] = summary.avgMs;
+    json["avg_fps"] = summary.avgMs > 0 ? 1000.0 / summary.avgMs : 0;
+    json["p99_ms"] = summary.p99Ms;
+    json["low_1_fps"] = summary.low1Fps;
+    json["low_0_1_fps"] = summary.low01Fps;
+    json["stutter_threshold_ms"] = stutterThresholdMs;
+    json["stutters"] = summary.stutters;
+    json["frame_times_ms"] = frames;
+    std::ofstream file(path);
+    if(!file) {
+        return false;
+    }
+    file << json.dump(2) << '\n';
+    return (bool)file;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct FrameStatsSummary {
+    size_t count = 0;
+    double avgMs = 0;
+    double p99Ms = 0;
+    double low1Fps = 0;
+    double low01Fps = 0;
+    size_t stutters = 0;
+};
+
+// Ring of recent frame times, written once per eglSwapBuffers and readable from any thread without locking
+struct FrameStats {
+    static constexpr size_t capacity = 4096;
+
+    static void recordFrame();
+    // Copies up to max of the most recent frame times in ms, oldest first, returns the number copied
+    static size_t snapshot(float* out, size_t max);
+    static FrameStatsSummary summarize(const float* frames, size_t count, float stutterThresholdMs);
+    static bool dumpCsv(const std::string& path);
+    // Number of frame times recorded since startup
+    static size_t getFrameCount();
+    // Appends the frame times recorded since next to out and advances next, returns how many of them the ring already
+    // overwrote. Benchmark runs call it periodically so runs of any length keep every frame
+    static size_t collect(size_t& next, std::vector<float>& out);
+    // Writes the summary and the frame times as json, used by benchmark runs
+    static bool dumpJson(const std::string& path, float stutterThresholdMs, const std::vector<float>& frames, size_t lostFrames);
+};
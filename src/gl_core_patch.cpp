@@ -43,7 +43,7 @@ void GLCorePatch::install(void *handle) {
     enabled = true;
 }
 
-void GLCorePatch::installGL(std::unordered_map<std::string, void *> &overrides, void *(*resolver)(const char *)) {
+void GLCorePatch::installGL(std::unordered_map<std::string_view, void *> &overrides, void *(*resolver)(const char *)) {
     if(!enabled)
         return;
 
@@ -3,6 +3,7 @@
 #include <cstddef>
 #include <unordered_map>
 #include <string>
+#include <string_view>
 
 class GLCorePatch {
 private:
@@ -28,7 +29,7 @@ private:
 public:
     static void install(void *handle);
 
-    static void installGL(std::unordered_map<std::string, void *> &overrides, void *(*resolver)(const char *));
+    static void installGL(std::unordered_map<std::string_view, void *> &overrides, void *(*resolver)(const char *));
 
     static bool mustUseDesktopGL();
 };
@@ -0,0 +1,233 @@
+#include "gpu_timer.h"
+#include "fake_egl.h"
+#include "util.h"
+
+#include <GLES3/gl3.h>
+#include <mcpelauncher/path_helper.h>
+#include <log.h>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <string_view>
+
+// Queries are read back this many frames late at most, older ones are dropped instead of stalling the pipeline
+static constexpr int kSlots = 4;
+
+struct GpuTimerSlot {
+    GLuint gameQuery = 0;
+    GLuint overlayQuery = 0;
+    bool hasGame = false;
+    bool pending = false;
+    double cpuMs = 0;
+    double overlayCpuMs = 0;
+};
+
+static bool initialized = false;
+static bool supported = false;
+static bool useExt = false;
+static PFNGLGETQUERYOBJECTUI64VPROC getQueryObjectui64v;
+static GpuTimerSlot slots[kSlots];
+static int currentSlot = 0;
+// Set while the slot has a game query, it ends in endFrame but the result is only read with the overlay query
+static bool gameQueryActive = false;
+static double lastSwapEndCpuMs = -1;
+static double overlayStartCpuMs = 0;
+static double pendingCpuMs = 0;
+static GpuFrameTimings timings;
+static std::ofstream statsLog;
+
+static double threadCpuMs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static bool hasExtension(std::string_view name) {
+    if(glGetStringi) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for(GLint i = 0; i < count; i++) {
+            auto ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if(ext && name == ext) {
+                return true;
+            }
+        }
+        // Drain GL_INVAL_ENUM of GLES2 contexts exposing glGetStringi
+        while(glGetError() != GL_NO_ERROR) {
+        }
+    }
+    auto exts = (const char*)glGetString(GL_EXTENSIONS);
+    return exts && strstr(exts, name.data());
+}
+
+static void init() {
+    initialized = true;
+    if(!glGetString) {
+        return;
+    }
+    if(GLAD_GL_EXT_disjoint_timer_query && glGenQueriesEXT && glGetQueryObjectui64vEXT) {
+        useExt = true;
+        getQueryObjectui64v = glGetQueryObjectui64vEXT;
+    } else if(glGenQueries && hasExtension("GL_ARB_timer_query")) {
+        // glad is loaded with gladLoadGLES2Loader, which leaves the desktop GL 3.3 / ARB_timer_query entry point unset
+        getQueryObjectui64v = glGetQueryObjectui64v ? glGetQueryObjectui64v : (PFNGLGETQUERYOBJECTUI64VPROC)fake_egl::eglGetProcAddress("glGetQueryObjectui64v");
+    }
+    supported = getQueryObjectui64v != nullptr;
+    if(supported) {
+        for(auto&& slot : slots) {
+            GLuint ids[2];
+            if(useExt) {
+                glGenQueriesEXT(2, ids);
+            } else {
+                glGenQueries(2, ids);
+            }
+            slot.gameQuery = ids[0];
+            slot.overlayQuery = ids[1];
+        }
+        Log::info("GpuTimer", "Using %s", useExt ? "GL_EXT_disjoint_timer_query" : "GL_ARB_timer_query");
+    } else {
+        Log::info("GpuTimer", "GPU timer queries are not supported, only reporting CPU timings");
+    }
+    if(ReadEnvFlag("MCPELAUNCHER_FRAME_STATS_LOG")) {
+        auto path = PathHelper::getPrimaryDataDirectory() + "frame_stats.csv";
+        statsLog.open(path, std::ios::trunc);
+        statsLog << "cpu_ms,gpu_ms,overlay_cpu_ms,overlay_gpu_ms\n";
+        Log::info("GpuTimer", "Writing frame stats to %s", path.data());
+    }
+}
+
+static void beginQuery(GLuint id) {
+    if(useExt) {
+        glBeginQueryEXT(GL_TIME_ELAPSED_EXT, id);
+    } else {
+        glBeginQuery(GL_TIME_ELAPSED, id);
+    }
+}
+
+static void endQuery() {
+    if(useExt) {
+        glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+    } else {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+}
+
+static bool isAvailable(GLuint id) {
+    GLuint available = GL_FALSE;
+    if(useExt) {
+        glGetQueryObjectuivEXT(id, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+    } else {
+        glGetQueryObjectuiv(id, GL_QUERY_RESULT_AVAILABLE, &available);
+    }
+    return available;
+}
+
+static double queryMs(GLuint id) {
+    GLuint64 ns = 0;
+    getQueryObjectui64v(id, GL_QUERY_RESULT, &ns);
+    return ns / 1000000.0;
+}
+
+static void publish(const GpuFrameTimings& frame) {
+    // Smooth the values so the hud stays readable
+    constexpr double alpha = 0.1;
+    timings.cpuMs += (frame.cpuMs - timings.cpuMs) * alpha;
+    timings.gpuMs += (frame.gpuMs - timings.gpuMs) * alpha;
+    timings.overlayCpuMs += (frame.overlayCpuMs - timings.overlayCpuMs) * alpha;
+    timings.overlayGpuMs += (frame.overlayGpuMs - timings.overlayGpuMs) * alpha;
+    if(statsLog.is_open()) {
+        statsLog << frame.cpuMs << ',' << frame.gpuMs << ',' << frame.overlayCpuMs << ',' << frame.overlayGpuMs << '\n';
+    }
+}
+
+static void collect() {
+    bool disjoint = false;
+    if(useExt) {
+        GLint value = 0;
+        glGetIntegerv(GL_GPU_DISJOINT_EXT, &value);
+        disjoint = value != 0;
+    }
+    // Walk from the oldest slot so results are published in frame order
+    for(int i = 0; i < kSlots; i++) {
+        auto& slot = slots[(currentSlot + i) % kSlots];
+        if(!slot.pending) {
+            continue;
+        }
+        if(disjoint) {
+            slot.pending = false;
+            continue;
+        }
+        if(!isAvailable(slot.overlayQuery)) {
+            break;
+        }
+        GpuFrameTimings frame;
+        frame.cpuMs = slot.cpuMs;
+        frame.overlayCpuMs = slot.overlayCpuMs;
+        frame.gpuMs = slot.hasGame ? queryMs(slot.gameQuery) : 0;
+        frame.overlayGpuMs = queryMs(slot.overlayQuery);
+        slot.pending = false;
+        publish(frame);
+    }
+}
+
+void GpuTimer::endFrame() {
+    if(!initialized) {
+        init();
+    }
+    pendingCpuMs = lastSwapEndCpuMs >= 0 ? threadCpuMs() - lastSwapEndCpuMs : 0;
+    if(supported && gameQueryActive) {
+        endQuery();
+    }
+}
+
+void GpuTimer::beginOverlay() {
+    if(!initialized) {
+        return;
+    }
+    overlayStartCpuMs = threadCpuMs();
+    if(supported) {
+        beginQuery(slots[currentSlot].overlayQuery);
+    }
+}
+
+void GpuTimer::endOverlay() {
+    if(!initialized) {
+        return;
+    }
+    double overlayCpuMs = threadCpuMs() - overlayStartCpuMs;
+    if(!supported) {
+        publish({.cpuMs = pendingCpuMs, .overlayCpuMs = overlayCpuMs});
+        return;
+    }
+    endQuery();
+    auto& slot = slots[currentSlot];
+    slot.hasGame = gameQueryActive;
+    slot.pending = true;
+    slot.cpuMs = pendingCpuMs;
+    slot.overlayCpuMs = overlayCpuMs;
+    gameQueryActive = false;
+    currentSlot = (currentSlot + 1) % kSlots;
+    collect();
+    // Still not finished after a full ring of frames, drop it instead of waiting
+    slots[currentSlot].pending = false;
+}
+
+void GpuTimer::onSwapBuffersDone() {
+    if(!initialized) {
+        return;
+    }
+    lastSwapEndCpuMs = threadCpuMs();
+    if(!supported) {
+        return;
+    }
+    beginQuery(slots[currentSlot].gameQuery);
+    gameQueryActive = true;
+}
+
+bool GpuTimer::isSupported() {
+    return supported;
+}
+
+GpuFrameTimings GpuTimer::getTimings() {
+    return timings;
+}
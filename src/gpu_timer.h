@@ -0,0 +1,25 @@
+#pragma once
+
+// CPU values are CPU time of the render thread, time spent blocked or descheduled is not included
+struct GpuFrameTimings {
+    double cpuMs = 0;
+    double gpuMs = 0;
+    double overlayCpuMs = 0;
+    double overlayGpuMs = 0;
+};
+
+// Per frame CPU / GPU timing around eglSwapBuffers, all methods must be called on the thread owning the GL context
+struct GpuTimer {
+    // Ends the game frame query, work the launcher does on the frame afterwards isn't counted as game time
+    static void endFrame();
+    // Starts timing the overlay
+    static void beginOverlay();
+    // Ends the overlay query and collects finished queries of older frames without blocking
+    static void endOverlay();
+    // Starts timing the next game frame
+    static void onSwapBuffersDone();
+
+    static bool isSupported();
+    // Smoothed timings of the most recent frames whose queries are available
+    static GpuFrameTimings getTimings();
+};
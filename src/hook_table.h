@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Symbols a fake library exports, kept in static arrays so no map has to be filled one assignment at a time
+struct HookTable {
+    const std::pair<const char*, void*>* entries;
+    size_t size;
+
+    template <size_t N>
+    HookTable(const std::pair<const char*, void*> (&table)[N]) : entries(table), size(N) {}
+
+    // linker::load_library only takes a map, build it sized once, entries of later tables replace earlier ones
+    static std::unordered_map<std::string, void*> merge(std::initializer_list<HookTable> tables) {
+        size_t count = 0;
+        for(auto&& table : tables) {
+            count += table.size;
+        }
+        std::unordered_map<std::string, void*> syms;
+        syms.reserve(count);
+        for(auto&& table : tables) {
+            for(size_t i = 0; i < table.size; i++) {
+                syms.insert_or_assign(table.entries[i].first, table.entries[i].second);
+            }
+        }
+        return syms;
+    }
+};
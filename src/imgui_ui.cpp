@@ -19,6 +19,13 @@
 #include <sstream>
 #include "window_callbacks.h"
 #include "core_patches.h"
+#include "gpu_timer.h"
+#include "frame_stats.h"
+#include "frame_capture.h"
+#include "jni/jni_profiler.h"
+#ifdef HAVE_SDL3AUDIO
+#include "fake_audio.h"
+#endif
 #include <mutex>
 #include <mcpelauncher/linker.h>
 
@@ -32,6 +39,18 @@ static bool rmbLast = false;
 
 static bool movingMode = false;
 
+// What the last full frame put on screen, used to skip or replay frames while nothing changes
+enum class OverlayContent {
+    Dynamic,
+    StaticHud,
+    Empty,
+};
+static OverlayContent lastOverlayContent = OverlayContent::Dynamic;
+static ImVec2 lastDisplaySize;
+// The fps hud is rebuilt at this rate, frames in between replay its draw lists
+static const double fpsHudRefreshInterval = 0.25;
+static double nextFpsHudRefresh = 0.0;
+
 static ImFont* fontDefaultSize;
 static ImFont* fontMediumSize;
 static ImFont* fontLargeSize;
@@ -349,10 +368,65 @@ static void CenterText(int x, int yPos, std::string text) {
     ImGui::RenderTextWrapped(start, text.c_str(), NULL, 999);
 }
 
+static double monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+// Draws the overlay, the backend saves and restores the GL state on every call so skip it when there is nothing to draw
+static void renderOverlay(ImDrawData* drawData) {
+    if(drawData && drawData->Valid && drawData->TotalVtxCount > 0) {
+        ImGui_ImplOpenGL3_RenderDrawData(drawData);
+    }
+}
+
+static OverlayContent currentOverlayContent(GameWindow* window) {
+    ImGuiContext& g = *ImGui::GetCurrentContext();
+    // Pending input may open the menubar or change the keystroke hud, a mouse resting on y=0 runs the menubar reveal timer
+    if(movingMode || g.InputEventsQueue.Size > 0 || g.IO.MousePos.y == 0) {
+        return OverlayContent::Dynamic;
+    }
+    bool fpsHud = canShowHud(Settings::enable_fps_hud);
+    if(fpsHud && monotonicSeconds() >= nextFpsHudRefresh) {
+        return OverlayContent::Dynamic;
+    }
+    if(!activeWindowsLock.try_lock()) {
+        return OverlayContent::Dynamic;
+    }
+    bool hasWindows = !activeWindows.empty();
+    activeWindowsLock.unlock();
+    if(hasWindows) {
+        return OverlayContent::Dynamic;
+    }
+    int32_t width, height;
+    window->getWindowSize(width, height);
+    if(lastDisplaySize.x != width || lastDisplaySize.y != height) {
+        return OverlayContent::Dynamic;
+    }
+    // The clicks per second counters decay over time
+    if(canShowHud(Settings::enable_keystroke_hud)) {
+        return lmb.empty() && rmb.empty() ? OverlayContent::StaticHud : OverlayContent::Dynamic;
+    }
+    return fpsHud ? OverlayContent::StaticHud : OverlayContent::Empty;
+}
+
 void ImGuiUIDrawFrame(GameWindow* window) {
     if(!Settings::enable_imgui.value_or(allowGPU) || !glViewport) {
         return;
     }
+    // Idle fast path, nothing drawn last frame and nothing can appear: skip the whole frame
+    // Only the huds visible and unchanged, or the fps hud between refreshes: draw the previous draw lists again without
+    // building a new frame
+    if(lastOverlayContent != OverlayContent::Dynamic) {
+        auto content = currentOverlayContent(window);
+        if(content == lastOverlayContent) {
+            if(content == OverlayContent::StaticHud) {
+                renderOverlay(ImGui::GetDrawData());
+            }
+            return;
+        }
+    }
     bool reloadFont = false;
     ImGuiIO& io = ImGui::GetIO();
     // Start the Dear ImGui frame
@@ -370,9 +444,7 @@ void ImGuiUIDrawFrame(GameWindow* window) {
         io.DisplayFramebufferScale = ImVec2((float)display_width / window_width, (float)display_height / window_height);
 
     // Setup time step
-    struct timespec current_timespec;
-    clock_gettime(CLOCK_MONOTONIC, &current_timespec);
-    double current_time = (double)(current_timespec.tv_sec) + (current_timespec.tv_nsec / 1000000000.0);
+    double current_time = monotonicSeconds();
     io.DeltaTime = g_Time > 0.0 ? (float)(current_time - g_Time) : (float)(1.0f / 60.0f);
     g_Time = current_time;
 
@@ -393,6 +465,7 @@ void ImGuiUIDrawFrame(GameWindow* window) {
     static auto show_demo_window = false;
     static auto show_confirm_popup = false;
     static auto show_about = false;
+    static auto show_jni_profiler = false;
     auto wantfocusnextframe = Settings::menubarFocusKey == "alt" && ImGui::IsKeyPressed(ImGuiKey_ModAlt) || Settings::menubarFocusKey == "shift+m+p" && ImGui::IsKeyPressed(ImGuiKey_LeftShift) && ImGui::IsKeyPressed(ImGuiKey_M) && ImGui::IsKeyPressed(ImGuiKey_P);
     if(wantfocusnextframe) {
         ImGui::SetNextFrameWantCaptureKeyboard(true);
@@ -507,6 +580,9 @@ void ImGuiUIDrawFrame(GameWindow* window) {
                 }
                 movingMode = !movingMode;
             }
+            if(JniProfiler::enabled) {
+                ImGui::MenuItem("JNI Profiler", nullptr, &show_jni_profiler);
+            }
             ImGui::EndMenu();
         }
         if(ImGui::BeginMenu("Video")) {
@@ -539,6 +615,25 @@ void ImGuiUIDrawFrame(GameWindow* window) {
             }
             ImGui::EndMenu();
         }
+        if(ImGui::BeginMenu("Capture")) {
+            if(ImGui::MenuItem("Take Screenshot")) {
+                FrameCapture::requestScreenshot();
+            }
+            if(ImGui::BeginMenu("Record Frames")) {
+                if(ImGui::MenuItem("Off", nullptr, FrameCapture::getSequenceInterval() == 0)) {
+                    FrameCapture::stopSequence();
+                }
+                for(int interval : {1, 2, 5, 10, 30}) {
+                    auto label = interval == 1 ? std::string("Every frame") : "Every " + std::to_string(interval) + ". frame";
+                    if(ImGui::MenuItem(label.data(), nullptr, FrameCapture::getSequenceInterval() == interval)) {
+                        FrameCapture::stopSequence();
+                        FrameCapture::startSequence(interval);
+                    }
+                }
+                ImGui::EndMenu();
+            }
+            ImGui::EndMenu();
+        }
         if(ImGui::BeginMenu("Help")) {
             ImGui::MenuItem("About", nullptr, &show_about);
             ImGui::EndMenu();
@@ -633,8 +728,80 @@ void ImGuiUIDrawFrame(GameWindow* window) {
     }
     if(show_demo_window)
         ImGui::ShowDemoWindow(&show_demo_window);
+    if(show_jni_profiler) {
+        if(ImGui::Begin("JNI Profiler", &show_jni_profiler)) {
+            if(ImGui::Button("Reset")) {
+                JniProfiler::reset();
+            }
+            ImGui::SameLine();
+            if(ImGui::Button("Dump JSON")) {
+                JniProfiler::dumpJson(JniProfiler::outputPath);
+            }
+            ImGui::SameLine();
+            ImGui::Text("%s", JniProfiler::outputPath.data());
+            if(ImGui::BeginTable("jni-calls", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable)) {
+                ImGui::TableSetupScrollFreeze(0, 1);
+                ImGui::TableSetupColumn("Method");
+                ImGui::TableSetupColumn("Direction");
+                ImGui::TableSetupColumn("Calls");
+                ImGui::TableSetupColumn("Total ms");
+                ImGui::TableSetupColumn("Avg us");
+                ImGui::TableSetupColumn("Max us");
+                ImGui::TableSetupColumn("Thread");
+                ImGui::TableHeadersRow();
+                for(auto&& entry : JniProfiler::snapshot()) {
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(entry.name.data());
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(entry.direction == JniProfiler::Direction::GameToLauncher ? "game -> launcher" : "launcher -> game");
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%llu", (unsigned long long)entry.calls);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", entry.totalNs / 1e6);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", entry.calls ? entry.totalNs / 1e3 / entry.calls : 0.0);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f", entry.maxNs / 1e3);
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(entry.thread.data());
+                }
+                ImGui::EndTable();
+            }
+        }
+        ImGui::End();
+    }
 
+    // F9 dumps the recorded frame times for stutter analysis
+    if(ImGui::IsKeyPressed(ImGuiKey_F9, false)) {
+        char timestamp[32];
+        time_t t = time(nullptr);
+        strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", localtime(&t));
+        auto path = PathHelper::getPrimaryDataDirectory() + "frametimes-" + timestamp + ".csv";
+        if(FrameStats::dumpCsv(path)) {
+            Log::info("FrameStats", "Wrote frame times to %s", path.data());
+        } else {
+            Log::error("FrameStats", "Failed to write frame times to %s", path.data());
+        }
+    }
     if(canShowHud(Settings::enable_fps_hud)) {
+        static float frameTimes[FrameStats::capacity];
+        static size_t frameTimesCount = 0;
+        static FrameStatsSummary summary;
+        static double recentFrameMs = 0;
+        // The hud only changes a few times per second, other full frames (menus, input) draw the last statistics again
+        if(g_Time >= nextFpsHudRefresh) {
+            frameTimesCount = FrameStats::snapshot(frameTimes, FrameStats::capacity);
+            summary = FrameStats::summarize(frameTimes, frameTimesCount, Settings::fps_hud_stutter_threshold);
+            // io.Framerate averages the delta of imgui frames, which are now far apart, use the game frames instead
+            size_t recentCount = std::min(frameTimesCount, (size_t)60);
+            double recentSum = 0;
+            for(size_t i = frameTimesCount - recentCount; i < frameTimesCount; i++) {
+                recentSum += frameTimes[i];
+            }
+            recentFrameMs = recentCount ? recentSum / recentCount : 0;
+            nextFpsHudRefresh = g_Time + fpsHudRefreshInterval;
+        }
         ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav;
         const float PAD = 10.0f;
         const ImGuiViewport* viewport = ImGui::GetMainViewport();
@@ -642,8 +809,16 @@ void ImGuiUIDrawFrame(GameWindow* window) {
         ImVec2 work_size = viewport->WorkSize;
         ImVec2 window_pos;
 
-        ImVec2 textSizeNoPad = ImGui::CalcTextSize("xxxx ms/frame (xxxx FPS)");
-        ImVec2 windowSize = ImVec2(textSizeNoPad.x + PAD * 4, textSizeNoPad.y + PAD * 2);
+        ImVec2 textSizeNoPad = ImGui::CalcTextSize("GPU xx.xx ms  CPU xx.xx ms");
+        const float graphHeight = 40.0f * Settings::scale;
+        int lines = 5;
+#ifdef HAVE_SDL3AUDIO
+        auto audio = FakeAudio::getLatencyStats();
+        if(audio.active) {
+            lines++;
+        }
+#endif
+        ImVec2 windowSize = ImVec2(textSizeNoPad.x + PAD * 4, textSizeNoPad.y * lines + graphHeight + PAD * 2);
 
         window_pos.x = (work_size.x - windowSize.x) * Settings::fps_hud_x;
         window_pos.y = (work_size.y - windowSize.y) * Settings::fps_hud_y;
@@ -661,7 +836,25 @@ void ImGuiUIDrawFrame(GameWindow* window) {
                 Settings::fps_hud_x = pos.x / (work_size.x - windowSize.x);
                 Settings::fps_hud_y = (pos.y - work_pos.y) / (work_size.y - windowSize.y);
             }
-            ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
+            ImGui::Text("%.3f ms/frame (%.1f FPS)", recentFrameMs, recentFrameMs > 0 ? 1000.0 / recentFrameMs : 0.0);
+            auto timings = GpuTimer::getTimings();
+            if(GpuTimer::isSupported()) {
+                ImGui::Text("GPU %.2f ms  CPU %.2f ms", timings.gpuMs, timings.cpuMs);
+                ImGui::Text("Overlay %.2f ms GPU %.2f ms CPU", timings.overlayGpuMs, timings.overlayCpuMs);
+            } else {
+                ImGui::Text("CPU %.2f ms", timings.cpuMs);
+                ImGui::Text("Overlay %.2f ms CPU", timings.overlayCpuMs);
+            }
+            ImGui::Text("1%% low %.1f  0.1%% low %.1f", summary.low1Fps, summary.low01Fps);
+            ImGui::Text("p99 %.2f ms  %zu stutters", summary.p99Ms, summary.stutters);
+#ifdef HAVE_SDL3AUDIO
+            if(audio.active) {
+                ImGui::Text("Audio%s %.1f ms  %d xruns", audio.lowLatency ? " (low latency)" : "", audio.latencyMs, audio.xRuns);
+            }
+#endif
+            const size_t graphFrames = 240;
+            size_t graphCount = std::min(frameTimesCount, graphFrames);
+            ImGui::PlotLines("##frametimes", frameTimes + frameTimesCount - graphCount, (int)graphCount, 0, nullptr, 0.0f, std::max(33.4f, (float)summary.p99Ms * 1.5f), ImVec2(textSizeNoPad.x, graphHeight));
         }
         ImGui::End();
     }
@@ -962,7 +1155,17 @@ void ImGuiUIDrawFrame(GameWindow* window) {
 
     // Rendering
     ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    renderOverlay(ImGui::GetDrawData());
+
+    lastDisplaySize = io.DisplaySize;
+    if(Settings::menubarsize || show_about || show_demo_window || showFilePicker || show_jni_profiler || ImGui::IsPopupOpen("", ImGuiPopupFlags_AnyPopupId)) {
+        lastOverlayContent = OverlayContent::Dynamic;
+    } else {
+        lastOverlayContent = currentOverlayContent(window);
+        if(lastOverlayContent == OverlayContent::Empty && ImGui::GetDrawData()->TotalVtxCount > 0) {
+            lastOverlayContent = OverlayContent::Dynamic;
+        }
+    }
 
     if(reloadFont) {
         ReloadFont();
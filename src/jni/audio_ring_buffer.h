@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+// Lock free byte ring for one producer and one consumer thread, e.g. FMOD's mixer and the audio callback
+class AudioRingBuffer {
+    std::unique_ptr<char[]> data;
+    size_t capacity = 0;
+    // Total bytes ever written and read, the difference is the fill level
+    std::atomic<size_t> writePos{0};
+    std::atomic<size_t> readPos{0};
+
+public:
+    // Not thread safe, only call while neither side is running
+    void reset(size_t size) {
+        if(size != capacity) {
+            data.reset(new char[size]);
+            capacity = size;
+        }
+        writePos = 0;
+        readPos = 0;
+    }
+
+    size_t size() const {
+        return capacity;
+    }
+
+    size_t readable() const {
+        return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_relaxed);
+    }
+
+    size_t writable() const {
+        return capacity - (writePos.load(std::memory_order_relaxed) - readPos.load(std::memory_order_acquire));
+    }
+
+    // Both return the number of bytes copied, which is less than length if the ring is full or empty
+    size_t write(const void *src, size_t length) {
+        size_t w = writePos.load(std::memory_order_relaxed);
+        length = std::min(length, capacity - (w - readPos.load(std::memory_order_acquire)));
+        if(length == 0) {
+            return 0;
+        }
+        size_t offset = w % capacity;
+        size_t first = std::min(length, capacity - offset);
+        memcpy(data.get() + offset, src, first);
+        memcpy(data.get(), (const char *)src + first, length - first);
+        writePos.store(w + length, std::memory_order_release);
+        return length;
+    }
+
+    size_t read(void *dst, size_t length) {
+        size_t r = readPos.load(std::memory_order_relaxed);
+        length = std::min(length, writePos.load(std::memory_order_acquire) - r);
+        if(length == 0) {
+            return 0;
+        }
+        size_t offset = r % capacity;
+        size_t first = std::min(length, capacity - offset);
+        memcpy(dst, data.get() + offset, first);
+        memcpy((char *)dst + first, data.get(), length - first);
+        readPos.store(r + length, std::memory_order_release);
+        return length;
+    }
+};
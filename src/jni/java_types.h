@@ -27,7 +27,8 @@ public:
 
     std::shared_ptr<FakeJni::JClass> loadClass(std::shared_ptr<FakeJni::JString> str) {
         FakeJni::JniEnvContext context;
-        return std::const_pointer_cast<FakeJni::JClass>(
-            context.getJniEnv().getVM().findClass(str->asStdString().c_str()));
+        // Through the env so the FindClass hooks, like lazy class registration, see this lookup too
+        auto &env = context.getJniEnv();
+        return std::dynamic_pointer_cast<FakeJni::JClass>(env.resolveReference(env.FindClass(str->asStdString().c_str())));
     }
 };
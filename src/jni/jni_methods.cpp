@@ -0,0 +1,86 @@
+#include "jni_methods.h"
+#include "main_activity.h"
+#include "lib_http_client.h"
+#include "lib_http_client_websocket.h"
+#include "xbox_live.h"
+#include <log.h>
+#include <atomic>
+#include <mutex>
+
+using Descriptor = decltype(MainActivity::getDescriptor());
+
+struct JniMethodEntry {
+    Descriptor (*descriptor)();
+    const char *signature;
+    const char *name;
+    JniMethodHandle handle;
+    std::atomic<bool> resolved{false};
+    // Set by resolveAll, get returns the missing handle without taking resolveMutex again
+    std::atomic<bool> missing{false};
+};
+
+static JniMethodEntry methods[] = {
+    {[] { return MainActivity::getDescriptor(); }, "()V", "nativeShutdown"},
+    {[] { return MainActivity::getDescriptor(); }, "(II)V", "nativeResize"},
+    {[] { return MainActivity::getDescriptor(); }, "(Ljava/lang/String;)V", "nativeSetTextboxText"},
+    {[] { return MainActivity::getDescriptor(); }, "(I)V", "nativeCaretPosition"},
+    {[] { return MainActivity::getDescriptor(); }, "()V", "nativeReturnKeyPressed"},
+    {[] { return MainActivity::getDescriptor(); }, "()V", "nativeBackPressed"},
+    {[] { return MainActivity::getDescriptor(); }, "(Ljava/lang/String;Ljava/lang/String;)V", "nativeProcessIntentUriQuery"},
+    {[] { return MainActivity::getDescriptor(); }, "(JJ)V", "nativeInitializeXboxLive"},
+    {[] { return NetworkMonitor::getDescriptor(); }, "(ZZZ)V", "nativeUpdateNetworkStatus"},
+    {[] { return HttpClientRequest::getDescriptor(); }, "(JLcom/xbox/httpclient/HttpClientResponse;)V", "OnRequestCompleted"},
+    {[] { return HttpClientRequest::getDescriptor(); }, "(JLjava/lang/String;)V", "OnRequestFailed"},
+    {[] { return HttpClientRequest::getDescriptor(); }, "(JLjava/lang/String;Ljava/lang/String;Ljava/lang/String;Z)V", "OnRequestFailed"},
+    {[] { return NetworkObserver::getDescriptor(); }, "(Ljava/lang/String;)V", "Log"},
+    {[] { return NativeInputStream::getDescriptor(); }, "(JJ[BJJ)I", "nativeRead"},
+    {[] { return NativeOutputStream::getDescriptor(); }, "(J[BII)V", "nativeWrite"},
+    {[] { return HttpClientWebSocket::getDescriptor(); }, "(Ljava/lang/String;)V", "onMessage"},
+    {[] { return HttpClientWebSocket::getDescriptor(); }, "(Ljava/nio/ByteBuffer;)V", "onBinaryMessage"},
+    {[] { return HttpClientWebSocket::getDescriptor(); }, "()V", "onOpen"},
+    {[] { return HttpClientWebSocket::getDescriptor(); }, "(I)V", "onClose"},
+    {[] { return HttpClientWebSocket::getDescriptor(); }, "()V", "onFailure"},
+    {[] { return XboxInterop::getDescriptor(); }, "(Ljava/lang/String;IILjava/lang/String;)V", "ticket_callback"},
+    {[] { return XboxInterop::getDescriptor(); }, "(JILjava/lang/String;)V", "auth_flow_callback"},
+    {[] { return XboxInterop::getDescriptor(); }, "()V", "sign_out_callback"},
+    {[] { return XboxInterop::getDescriptor(); }, "(JLjava/lang/String;Lcom/microsoft/xbox/idp/interop/Interop$XBLoginCallback;)V", "invoke_xb_login"},
+    {[] { return XboxInterop::getDescriptor(); }, "(JLjava/lang/String;Lcom/microsoft/xbox/idp/interop/Interop$EventInitializationCallback;)V", "invoke_event_initialization"},
+};
+static_assert(sizeof(methods) / sizeof(methods[0]) == (size_t)JniMethod::Count, "The method table is out of sync with JniMethod");
+
+static std::mutex resolveMutex;
+
+static bool resolve(JniMethodEntry &entry) {
+    std::lock_guard<std::mutex> lock(resolveMutex);
+    if(entry.resolved.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    entry.handle.method = entry.descriptor()->getMethod(entry.signature, entry.name);
+    if(!entry.handle.method) {
+        return false;
+    }
+    entry.handle.label = std::string(entry.name) + entry.signature;
+    entry.resolved.store(true, std::memory_order_release);
+    return true;
+}
+
+void JniMethods::resolveAll() {
+    for(auto &&entry : methods) {
+        if(!resolve(entry)) {
+            entry.missing.store(true, std::memory_order_relaxed);
+            Log::info("JniMethods", "%s%s is not provided by this game version", entry.name, entry.signature);
+        }
+    }
+}
+
+JniMethodHandle const &JniMethods::get(JniMethod id) {
+    static const JniMethodHandle missing;
+    auto &entry = methods[(size_t)id];
+    if(entry.resolved.load(std::memory_order_acquire)) {
+        return entry.handle;
+    }
+    if(entry.missing.load(std::memory_order_relaxed) || !resolve(entry)) {
+        return missing;
+    }
+    return entry.handle;
+}
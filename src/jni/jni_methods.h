@@ -0,0 +1,67 @@
+#pragma once
+
+#include <fake-jni/fake-jni.h>
+#include "jni_profiler.h"
+#include <string>
+#include <utility>
+
+// Java methods the launcher calls on the game, in the order of the table in jni_methods.cpp
+enum class JniMethod {
+    MainActivityShutdown,
+    MainActivityResize,
+    MainActivitySetTextboxText,
+    MainActivityCaretPosition,
+    MainActivityReturnKeyPressed,
+    MainActivityBackPressed,
+    MainActivityProcessIntentUriQuery,
+    MainActivityInitializeXboxLive,
+    NetworkMonitorUpdateNetworkStatus,
+    HttpClientRequestCompleted,
+    HttpClientRequestFailed,
+    HttpClientRequestFailedWithDetails,
+    NetworkObserverLog,
+    NativeInputStreamRead,
+    NativeOutputStreamWrite,
+    WebSocketMessage,
+    WebSocketBinaryMessage,
+    WebSocketOpen,
+    WebSocketClose,
+    WebSocketFailure,
+    XboxTicketCallback,
+    XboxAuthFlowCallback,
+    XboxSignOutCallback,
+    XboxInvokeXbLogin,
+    XboxInvokeEventInitialization,
+    Count
+};
+
+// A resolved method, invoke is measured by the JniProfiler when it is enabled
+struct JniMethodHandle {
+    using Method = decltype(std::declval<FakeJni::JClass const &>().getMethod("", ""));
+
+    Method method;
+    std::string label;
+
+    explicit operator bool() const {
+        return (bool)method;
+    }
+    const JniMethodHandle *operator->() const {
+        return this;
+    }
+    template <class... Args>
+    auto invoke(Args &&...args) const {
+        if(!JniProfiler::enabled) {
+            return method->invoke(std::forward<Args>(args)...);
+        }
+        JniProfiler::Scope scope(this, JniProfiler::Direction::LauncherToGame, [](const void *self) { return ((const JniMethodHandle *)self)->label; });
+        return method->invoke(std::forward<Args>(args)...);
+    }
+};
+
+// Resolves the methods once instead of looking them up by signature on every call
+struct JniMethods {
+    // Called after registerMinecraftNatives, reports methods the game doesn't provide
+    static void resolveAll();
+    // Methods used before resolveAll are looked up on demand, ones it found missing stay missing
+    static JniMethodHandle const &get(JniMethod id);
+};
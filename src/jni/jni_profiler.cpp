@@ -0,0 +1,225 @@
+#include "jni_profiler.h"
+#include <baron/baron.h>
+#include <log.h>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cstdarg>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+
+bool JniProfiler::enabled = false;
+std::string JniProfiler::outputPath;
+
+namespace {
+struct ThreadEntry {
+    JniProfiler::Entry entry;
+    std::chrono::steady_clock::time_point firstCall;
+};
+// Every thread records into its own table, the lock is only contended by snapshot and reset
+struct ThreadEntries {
+    std::mutex lock;
+    std::unordered_map<const void *, ThreadEntry> entries;
+};
+}  // namespace
+
+static std::mutex threadsLock;
+static std::vector<std::shared_ptr<ThreadEntries>> threads;
+
+static ThreadEntries &getThreadEntries() {
+    thread_local std::shared_ptr<ThreadEntries> local = [] {
+        auto entries = std::make_shared<ThreadEntries>();
+        std::lock_guard<std::mutex> lock(threadsLock);
+        threads.push_back(entries);
+        return entries;
+    }();
+    return *local;
+}
+
+void JniProfiler::record(const void *key, Direction direction, uint64_t ns, std::string (*name)(const void *key)) {
+    auto &local = getThreadEntries();
+    std::lock_guard<std::mutex> lock(local.lock);
+    auto it = local.entries.find(key);
+    if(it == local.entries.end()) {
+        char thread[32] = "";
+        pthread_getname_np(pthread_self(), thread, sizeof(thread));
+        it = local.entries.emplace(key, ThreadEntry{Entry{name(key), direction, 0, 0, 0, thread}, std::chrono::steady_clock::now()}).first;
+    }
+    auto &entry = it->second.entry;
+    entry.calls++;
+    entry.totalNs += ns;
+    entry.maxNs = std::max(entry.maxNs, ns);
+}
+
+std::vector<JniProfiler::Entry> JniProfiler::snapshot() {
+    std::unordered_map<const void *, ThreadEntry> merged;
+    {
+        std::lock_guard<std::mutex> lock(threadsLock);
+        for(auto &&thread : threads) {
+            std::lock_guard<std::mutex> threadLock(thread->lock);
+            for(auto &&it : thread->entries) {
+                auto inserted = merged.emplace(it.first, it.second);
+                if(inserted.second) {
+                    continue;
+                }
+                auto &total = inserted.first->second;
+                total.entry.calls += it.second.entry.calls;
+                total.entry.totalNs += it.second.entry.totalNs;
+                total.entry.maxNs = std::max(total.entry.maxNs, it.second.entry.maxNs);
+                if(it.second.firstCall < total.firstCall) {
+                    total.firstCall = it.second.firstCall;
+                    total.entry.thread = it.second.entry.thread;
+                }
+            }
+        }
+    }
+    std::vector<Entry> result;
+    result.reserve(merged.size());
+    for(auto &&it : merged) {
+        result.push_back(std::move(it.second.entry));
+    }
+    std::sort(result.begin(), result.end(), [](const Entry &a, const Entry &b) { return a.totalNs > b.totalNs; });
+    return result;
+}
+
+void JniProfiler::reset() {
+    std::lock_guard<std::mutex> lock(threadsLock);
+    for(auto &&thread : threads) {
+        std::lock_guard<std::mutex> threadLock(thread->lock);
+        thread->entries.clear();
+    }
+}
+
+bool JniProfiler::dumpJson(const std::string &path) {
+    auto json = nlohmann::json::array();
+    for(auto &&entry : snapshot()) {
+        json.push_back({
+            {"name", entry.name},
+            {"direction", entry.direction == Direction::GameToLauncher ? "game_to_launcher" : "launcher_to_game"},
+            {"calls", entry.calls},
+            {"total_ms", entry.totalNs / 1e6},
+            {"avg_us", entry.calls ? entry.totalNs / 1e3 / entry.calls : 0},
+            {"max_us", entry.maxNs / 1e3},
+            {"thread", entry.thread},
+        });
+    }
+    std::ofstream file(path);
+    file << json.dump(4);
+    return (bool)file;
+}
+
+static std::string methodName(const void *key) {
+    auto method = (const jnivm::Method *)key;
+    return method->name + method->signature;
+}
+
+namespace {
+struct GameCall {
+    JniProfiler::Scope scope;
+    GameCall(jmethodID id) : scope(id, JniProfiler::Direction::GameToLauncher, methodName) {}
+};
+struct VaListEnd {
+    va_list &args;
+    ~VaListEnd() {
+        va_end(args);
+    }
+};
+}  // namespace
+
+// The variadic and A variants are forwarded to the original V / A functions so every call is measured exactly once
+#define PROFILED_CALLS(Type, Ret)                                                                           \
+    static decltype(JNINativeInterface::Call##Type##MethodV) origCall##Type##MethodV;                       \
+    static decltype(JNINativeInterface::Call##Type##MethodA) origCall##Type##MethodA;                       \
+    static decltype(JNINativeInterface::CallStatic##Type##MethodV) origCallStatic##Type##MethodV;           \
+    static decltype(JNINativeInterface::CallStatic##Type##MethodA) origCallStatic##Type##MethodA;           \
+    static Ret profiledCall##Type##MethodV(JNIEnv *env, jobject obj, jmethodID id, va_list args) {          \
+        GameCall call(id);                                                                                  \
+        return origCall##Type##MethodV(env, obj, id, args);                                                 \
+    }                                                                                                       \
+    static Ret profiledCall##Type##Method(JNIEnv *env, jobject obj, jmethodID id, ...) {                    \
+        va_list args;                                                                                       \
+        va_start(args, id);                                                                                 \
+        VaListEnd end{args};                                                                                \
+        return profiledCall##Type##MethodV(env, obj, id, args);                                             \
+    }                                                                                                       \
+    static Ret profiledCall##Type##MethodA(JNIEnv *env, jobject obj, jmethodID id, const jvalue *args) {    \
+        GameCall call(id);                                                                                  \
+        return origCall##Type##MethodA(env, obj, id, args);                                                 \
+    }                                                                                                       \
+    static Ret profiledCallStatic##Type##MethodV(JNIEnv *env, jclass cls, jmethodID id, va_list args) {     \
+        GameCall call(id);                                                                                  \
+        return origCallStatic##Type##MethodV(env, cls, id, args);                                           \
+    }                                                                                                       \
+    static Ret profiledCallStatic##Type##Method(JNIEnv *env, jclass cls, jmethodID id, ...) {               \
+        va_list args;                                                                                       \
+        va_start(args, id);                                                                                 \
+        VaListEnd end{args};                                                                                \
+        return profiledCallStatic##Type##MethodV(env, cls, id, args);                                       \
+    }                                                                                                       \
+    static Ret profiledCallStatic##Type##MethodA(JNIEnv *env, jclass cls, jmethodID id, const jvalue *args) { \
+        GameCall call(id);                                                                                  \
+        return origCallStatic##Type##MethodA(env, cls, id, args);                                           \
+    }                                                                                                       \
+    static decltype(JNINativeInterface::CallNonvirtual##Type##MethodV) origCallNonvirtual##Type##MethodV;   \
+    static decltype(JNINativeInterface::CallNonvirtual##Type##MethodA) origCallNonvirtual##Type##MethodA;   \
+    static Ret profiledCallNonvirtual##Type##MethodV(JNIEnv *env, jobject obj, jclass cls, jmethodID id, va_list args) { \
+        GameCall call(id);                                                                                  \
+        return origCallNonvirtual##Type##MethodV(env, obj, cls, id, args);                                  \
+    }                                                                                                       \
+    static Ret profiledCallNonvirtual##Type##Method(JNIEnv *env, jobject obj, jclass cls, jmethodID id, ...) { \
+        va_list args;                                                                                       \
+        va_start(args, id);                                                                                 \
+        VaListEnd end{args};                                                                                \
+        return profiledCallNonvirtual##Type##MethodV(env, obj, cls, id, args);                              \
+    }                                                                                                       \
+    static Ret profiledCallNonvirtual##Type##MethodA(JNIEnv *env, jobject obj, jclass cls, jmethodID id, const jvalue *args) { \
+        GameCall call(id);                                                                                  \
+        return origCallNonvirtual##Type##MethodA(env, obj, cls, id, args);                                  \
+    }                                                                                                       \
+    static void hook##Type(JNINativeInterface &interface) {                                                 \
+        origCall##Type##MethodV = interface.Call##Type##MethodV;                                            \
+        origCall##Type##MethodA = interface.Call##Type##MethodA;                                            \
+        origCallStatic##Type##MethodV = interface.CallStatic##Type##MethodV;                                \
+        origCallStatic##Type##MethodA = interface.CallStatic##Type##MethodA;                                \
+        interface.Call##Type##Method = profiledCall##Type##Method;                                          \
+        interface.Call##Type##MethodV = profiledCall##Type##MethodV;                                        \
+        interface.Call##Type##MethodA = profiledCall##Type##MethodA;                                        \
+        interface.CallStatic##Type##Method = profiledCallStatic##Type##Method;                              \
+        interface.CallStatic##Type##MethodV = profiledCallStatic##Type##MethodV;                            \
+        interface.CallStatic##Type##MethodA = profiledCallStatic##Type##MethodA;                            \
+        origCallNonvirtual##Type##MethodV = interface.CallNonvirtual##Type##MethodV;                        \
+        origCallNonvirtual##Type##MethodA = interface.CallNonvirtual##Type##MethodA;                        \
+        interface.CallNonvirtual##Type##Method = profiledCallNonvirtual##Type##Method;                      \
+        interface.CallNonvirtual##Type##MethodV = profiledCallNonvirtual##Type##MethodV;                    \
+        interface.CallNonvirtual##Type##MethodA = profiledCallNonvirtual##Type##MethodA;                    \
+    }
+
+PROFILED_CALLS(Object, jobject)
+PROFILED_CALLS(Boolean, jboolean)
+PROFILED_CALLS(Byte, jbyte)
+PROFILED_CALLS(Char, jchar)
+PROFILED_CALLS(Short, jshort)
+PROFILED_CALLS(Int, jint)
+PROFILED_CALLS(Long, jlong)
+PROFILED_CALLS(Float, jfloat)
+PROFILED_CALLS(Double, jdouble)
+PROFILED_CALLS(Void, void)
+
+void JniProfiler::installHooks(JNINativeInterface &interface) {
+    if(interface.CallVoidMethodV == profiledCallVoidMethodV) {
+        return;
+    }
+    hookObject(interface);
+    hookBoolean(interface);
+    hookByte(interface);
+    hookChar(interface);
+    hookShort(interface);
+    hookInt(interface);
+    hookLong(interface);
+    hookFloat(interface);
+    hookDouble(interface);
+    hookVoid(interface);
+}
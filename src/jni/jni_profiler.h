@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct JNINativeInterface;
+
+// Optional call statistics for both directions of the JNI boundary, enabled with --jni-profile
+struct JniProfiler {
+    enum class Direction {
+        GameToLauncher,
+        LauncherToGame
+    };
+
+    struct Entry {
+        std::string name;
+        Direction direction;
+        uint64_t calls;
+        uint64_t totalNs;
+        uint64_t maxNs;
+        // Name of the thread that made the first call
+        std::string thread;
+    };
+
+    // Only read after startup, the hooks are installed when the jvm is created
+    static bool enabled;
+    static std::string outputPath;
+
+    // Wraps the Call*Method*, CallStatic*Method* and CallNonvirtual*Method* functions the game uses to call into the launcher
+    static void installHooks(JNINativeInterface &interface);
+
+    // Each thread records into its own table, name is only called the first time a thread sees key
+    static void record(const void *key, Direction direction, uint64_t ns, std::string (*name)(const void *key));
+    static std::vector<Entry> snapshot();
+    static void reset();
+    static bool dumpJson(const std::string &path);
+
+    class Scope {
+        const void *key;
+        Direction direction;
+        std::string (*name)(const void *);
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        Scope(const void *key, Direction direction, std::string (*name)(const void *)) : key(key), direction(direction), name(name), start(std::chrono::steady_clock::now()) {}
+        ~Scope() {
+            record(key, direction, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), name);
+        }
+    };
+};
@@ -6,6 +6,9 @@
 #include "fmod.h"
 #include "lib_http_client.h"
 #include "lib_http_client_websocket.h"
+#include "lib_http_client_recorder.h"
+#include "jni_methods.h"
+#include "jni_profiler.h"
 #include "cert_manager.h"
 #include "asset_manager.h"
 #include "package_source.h"
@@ -33,17 +36,101 @@
 #include "securerandom.h"
 #include "../settings.h"
 #include "../main.h"
+#include "../network_reachability.h"
+#include "../file_transfer.h"
+#include <game_window_manager.h>
 #include <thread>
 #include <iostream>
 #include <fstream>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <cstdlib>
 #include <regex>
 #include <sstream>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
 #if !defined(_GLIBCXX_RELEASE) || _GLIBCXX_RELEASE > 8
 #include <filesystem>
 #endif
 
+// Classes only some game versions look up, with lazy registration they are registered on the first FindClass,
+// ClassLoader.loadClass or GetObjectClass for one of them
+namespace {
+struct LazyClassGroup {
+    void (*registrar)(Baron::Jvm &vm);
+    bool registered;
+};
+}  // namespace
+static std::vector<LazyClassGroup> lazyClassGroups;
+static std::unordered_map<std::string, size_t> lazyClassNames;
+static std::mutex lazyClassLock;
+static std::atomic<size_t> lazyClassGroupsPending;
+static Baron::Jvm *lazyClassVm;
+static decltype(JNINativeInterface::FindClass) origFindClass;
+static decltype(JNINativeInterface::GetObjectClass) origGetObjectClass;
+
+static void registerLazyClass(const char *name) {
+    if(lazyClassGroupsPending.load(std::memory_order_acquire) == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(lazyClassLock);
+    auto it = lazyClassNames.find(name);
+    if(it != lazyClassNames.end() && !lazyClassGroups[it->second].registered) {
+        lazyClassGroups[it->second].registered = true;
+        lazyClassGroups[it->second].registrar(*lazyClassVm);
+        lazyClassGroupsPending.fetch_sub(1, std::memory_order_release);
+#ifndef NDEBUG
+        Log::trace("JniSupport", "Registered %s on first use", name);
+#endif
+    }
+}
+
+static jclass lazyFindClass(JNIEnv *env, const char *name) {
+    registerLazyClass(name);
+    return origFindClass(env, name);
+}
+
+static jclass lazyGetObjectClass(JNIEnv *env, jobject obj) {
+    if(obj && lazyClassGroupsPending.load(std::memory_order_acquire) != 0) {
+        FakeJni::JniEnvContext context;
+        if(auto object = context.getJniEnv().resolveReference(obj)) {
+            registerLazyClass(object->getClass().getName());
+        }
+    }
+    return origGetObjectClass(env, obj);
+}
+
+template <class... T>
+void JniSupport::registerLazyClasses() {
+    if(!Settings::enable_lazy_jni_classes) {
+        (vm.registerClass<T>(), ...);
+        return;
+    }
+    // Related classes are registered together, our code creates instances of them without a FindClass
+    std::lock_guard<std::mutex> lock(lazyClassLock);
+    for(auto &&name : {std::string(T::getDescriptor()->getName())...}) {
+        lazyClassNames[name] = lazyClassGroups.size();
+    }
+    lazyClassGroups.push_back({[](Baron::Jvm &vm) { (vm.registerClass<T>(), ...); }, false});
+    lazyClassGroupsPending.fetch_add(1, std::memory_order_release);
+}
+
 void JniSupport::registerJniClasses() {
+    auto start = std::chrono::steady_clock::now();
+    if(Settings::enable_lazy_jni_classes) {
+        lazyClassVm = &vm;
+        vm.AddHook([](JNINativeInterface &in) {
+            if(in.FindClass != lazyFindClass) {
+                origFindClass = in.FindClass;
+                in.FindClass = lazyFindClass;
+            }
+            if(in.GetObjectClass != lazyGetObjectClass) {
+                origGetObjectClass = in.GetObjectClass;
+                in.GetObjectClass = lazyGetObjectClass;
+            }
+        });
+    }
     vm.registerClass<File>();
     vm.registerClass<ClassLoader>();
     vm.registerClass<Locale>();
@@ -88,21 +175,15 @@ void JniSupport::registerJniClasses() {
     vm.registerClass<TrustManagerFactory>();
     vm.registerClass<StrictHostnameVerifier>();
 
-    vm.registerClass<PackageSource>();
-    vm.registerClass<PackageSourceListener>();
-    vm.registerClass<NativePackageSourceListener>();
-    vm.registerClass<PackageSourceFactory>();
-
-    vm.registerClass<Header>();
-    vm.registerClass<HTTPResponse>();
-    vm.registerClass<HTTPRequest>();
+    registerLazyClasses<PackageSource, PackageSourceListener, NativePackageSourceListener, PackageSourceFactory>();
+    registerLazyClasses<Header, HTTPResponse, HTTPRequest>();
 
 #ifndef NO_OPENSSL
     vm.registerClass<ShaHasher>();
 #endif
     vm.registerClass<SecureRandom>();
     // Minecraft 1.16.20-210
-    vm.registerClass<WebView>();
+    registerLazyClasses<WebView>();
     // Minecraft 1.16.220+
     vm.registerClass<BrowserLaunchActivity>();
 
@@ -122,6 +203,7 @@ void JniSupport::registerJniClasses() {
 #if defined(HAVE_PULSEAUDIO) || defined(HAVE_SDL3AUDIO)
     vm.registerClass<AudioDevice>();
 #endif
+    Log::debug("JniSupport", "Registered jni classes in %.2f ms, %zu classes deferred until first use", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), lazyClassNames.size());
 }
 
 void JniSupport::registerMinecraftNatives(void *(*symResolver)(const char *)) {
@@ -161,6 +243,7 @@ void JniSupport::registerMinecraftNatives(void *(*symResolver)(const char *)) {
                                                         {"nativePlayIntegrityComplete", "()V"},
                                                     },
                     symResolver);
+    JniMethods::resolveAll();
 }
 
 JniSupport::JniSupport() : textInput([this](std::string const &str) { return onSetTextboxText(str); }, [this](int pos) { return onCaretPosition(pos); })
@@ -189,6 +272,11 @@ JniSupport::JniSupport() : textInput([this](std::string const &str) { return onS
                            })
 #endif
 {
+    if(JniProfiler::enabled) {
+        vm.AddHook([](JNINativeInterface &in) {
+            JniProfiler::installHooks(in);
+        });
+    }
     registerJniClasses();
 }
 
@@ -286,9 +374,19 @@ void JniSupport::startGame(ANativeActivity_createFunc *activityOnCreate, GameAct
 
     std::shared_ptr<NetworkMonitor> network;
     network = std::make_shared<NetworkMonitor>();
-    auto updateNetworkStatus = network->getClass().getMethod("(ZZZ)V", "nativeUpdateNetworkStatus");
-    if(updateNetworkStatus)
-        updateNetworkStatus->invoke(frame.getJniEnv(), network.get(), true, true, true);
+    auto &updateNetworkStatus = JniMethods::get(JniMethod::NetworkMonitorUpdateNetworkStatus);
+    // Replayed sessions are meant to run without network, keep reporting it as available
+    if(HttpClientRecorder::mode != HttpClientRecorder::Mode::Replay) {
+        NetworkReachability::start([this, network, &updateNetworkStatus](bool online) {
+            FakeJni::LocalFrame frame(vm);
+            if(updateNetworkStatus)
+                updateNetworkStatus->invoke(frame.getJniEnv(), network.get(), online, online, online);
+        });
+    }
+    if(updateNetworkStatus) {
+        bool online = NetworkReachability::isOnline();
+        updateNetworkStatus->invoke(frame.getJniEnv(), network.get(), online, online, online);
+    }
 
     if(!options.importFilePath.empty()) {
         importFile(options.importFilePath);
@@ -346,13 +444,26 @@ void JniSupport::sendUri(std::string uri) {
             query = urlDecode(query_match[1].str());
         }
 
-        auto urlLaunch = activity->getClass().getMethod("(Ljava/lang/String;Ljava/lang/String;)V", "nativeProcessIntentUriQuery");
+        auto &urlLaunch = JniMethods::get(JniMethod::MainActivityProcessIntentUriQuery);
         urlLaunch->invoke(frame.getJniEnv(), activity.get(), std::make_shared<FakeJni::JString>(host.c_str()), std::make_shared<FakeJni::JString>(query.c_str()));  // The game expects it to be parsed using the java getHost() and getQuery() methods
     } else {
         Log::warn("JniSupport", "Not sending URI %s, not a valid Minecraft URI", uri.c_str());
     }
 }
 
+static std::mutex importedFilesLock;
+static std::vector<std::string> importedFiles;
+
+void JniSupport::removeImportedFiles() {
+    std::lock_guard<std::mutex> lock(importedFilesLock);
+    for(auto &&file : importedFiles) {
+        // The game already deleted the ones it imported successfully
+        unlink(file.c_str());
+        rmdir(file.substr(0, file.find_last_of('/')).c_str());
+    }
+    importedFiles.clear();
+}
+
 void JniSupport::importFile(std::string path) {
 #if !defined(_GLIBCXX_RELEASE) || _GLIBCXX_RELEASE > 8
     std::string tmpDir = std::filesystem::temp_directory_path().generic_string();
@@ -361,27 +472,39 @@ void JniSupport::importFile(std::string path) {
 #endif
     std::string fileExt = path.substr(path.find_last_of(".") + 1);
     if(fileExt == "mcworld" || fileExt == "mcpack" || fileExt == "mcaddon" || fileExt == "mctemplate") {
-        FakeJni::LocalFrame frame(vm);
-        try {
-            std::string fileName = path.substr(path.find_last_of("/") + 1);
-            if(path.find("&") == std::string::npos) {
-                std::ifstream src(path, std::ios::binary);
-                if(!src.is_open()) {
-                    throw std::runtime_error("Error opening file: " + path);
+        std::string fileName = path.substr(path.find_last_of("/") + 1);
+        if(path.find("&") == std::string::npos) {
+            // We have to copy it to the temp folder because the game will delete the archive if importing succeeds.
+            // A hardlink is enough for that, large worlds are copied on a worker thread instead of blocking the caller.
+            // Each import gets its own directory, two files with the same name imported at once must not replace each other
+            std::string importDir = tmpDir + "/mcpelauncher-import-XXXXXX";
+            if(!mkdtemp(importDir.data())) {
+                Log::error("JniSupport", "Failed to import file at %s: could not create a directory in %s", path.c_str(), tmpDir.c_str());
+                return;
+            }
+            std::string dest = importDir + "/" + fileName;
+            {
+                std::lock_guard<std::mutex> lock(importedFilesLock);
+                importedFiles.push_back(dest);
+            }
+            FileTransfer::copyAsync(path, dest, true, [this, path, dest](bool ok) {
+                if(!ok) {
+                    Log::error("JniSupport", "Failed to import file at %s: could not copy it to %s", path.c_str(), dest.c_str());
+                    GameWindowManager::getManager()->getErrorHandler()->onError("Import failed", "Failed to import " + path + ", see the log for details");
+                    return;
                 }
-                std::ofstream dest(tmpDir + "/" + fileName, std::ios::binary);
-                if(!dest.is_open()) {
-                    throw std::runtime_error("Error opening file: " + path);
+                static std::mutex importLock;
+                std::lock_guard<std::mutex> lock(importLock);
+                try {
+                    FakeJni::LocalFrame frame(vm);
+                    auto &fileOpen = JniMethods::get(JniMethod::MainActivityProcessIntentUriQuery);
+                    fileOpen->invoke(frame.getJniEnv(), activity.get(), std::make_shared<FakeJni::JString>("contentIntent"), std::make_shared<FakeJni::JString>(path + "&" + dest));
+                } catch(std::exception &e) {
+                    Log::error("JniSupport", "Failed to import file at %s: %s", path.c_str(), e.what());
                 }
-                dest << src.rdbuf();  // We have to copy it to the temp folder because the game will delete the archive if importing succeeds.
-
-                auto fileOpen = activity->getClass().getMethod("(Ljava/lang/String;Ljava/lang/String;)V", "nativeProcessIntentUriQuery");
-                fileOpen->invoke(frame.getJniEnv(), activity.get(), std::make_shared<FakeJni::JString>("contentIntent"), std::make_shared<FakeJni::JString>(path + "&" + tmpDir + "/" + fileName));
-            } else {
-                Log::warn("JniSupport", "Not importing file at %s; file path cannot contain &", path.c_str());
-            }
-        } catch(std::exception &e) {
-            Log::error("JniSupport", "Failed to import file at %s: %s", path.c_str(), e.what());
+            });
+        } else {
+            Log::warn("JniSupport", "Not importing file at %s; file path cannot contain &", path.c_str());
         }
     } else {
         Log::warn("JniSupport", "Not importing file at %s; file extension must be .mcworld, .mcpack, .mcaddon, or .mctemplate", path.c_str());
@@ -449,13 +572,13 @@ void JniSupport::onWindowCreated(ANativeWindow *window, AInputQueue *inputQueue)
 
 void JniSupport::onWindowClosed() {
     FakeJni::LocalFrame frame(vm);
-    auto shutdown = activity->getClass().getMethod("()V", "nativeShutdown");
+    auto &shutdown = JniMethods::get(JniMethod::MainActivityShutdown);
     shutdown->invoke(frame.getJniEnv(), activity.get());
 }
 
 void JniSupport::onWindowResized(int newWidth, int newHeight) {
     FakeJni::LocalFrame frame(vm);
-    auto resize = activity->getClass().getMethod("(II)V", "nativeResize");
+    auto &resize = JniMethods::get(JniMethod::MainActivityResize);
     if(resize)
         resize->invoke(frame.getJniEnv(), activity.get(), newWidth, newHeight);
 }
@@ -463,7 +586,7 @@ void JniSupport::onWindowResized(int newWidth, int newHeight) {
 void JniSupport::onSetTextboxText(std::string const &text) {
     if(!Settings::enable_keyboard_autofocus_patches_1_20_60 || getTextInputHandler().isEnabled()) {
         FakeJni::LocalFrame frame(vm);
-        auto setText = activity->getClass().getMethod("(Ljava/lang/String;)V", "nativeSetTextboxText");
+        auto &setText = JniMethods::get(JniMethod::MainActivitySetTextboxText);
         if(setText) {
             auto str = std::make_shared<FakeJni::JString>(text);
             setText->invoke(frame.getJniEnv(), activity.get(), frame.getJniEnv().createLocalReference(str));
@@ -480,7 +603,7 @@ void JniSupport::setLastChar(FakeJni::JInt sym) {
 }
 
 void JniSupport::onCaretPosition(int pos) {
-    auto method = activity->getClass().getMethod("(I)V", "nativeCaretPosition");
+    auto &method = JniMethods::get(JniMethod::MainActivityCaretPosition);
     if(method) {
         FakeJni::LocalFrame frame;
         method->invoke(frame.getJniEnv(), activity.get(), pos);
@@ -489,14 +612,14 @@ void JniSupport::onCaretPosition(int pos) {
 
 void JniSupport::onReturnKeyPressed() {
     FakeJni::LocalFrame frame(vm);
-    auto returnPressed = activity->getClass().getMethod("()V", "nativeReturnKeyPressed");
+    auto &returnPressed = JniMethods::get(JniMethod::MainActivityReturnKeyPressed);
     if(returnPressed)
         returnPressed->invoke(frame.getJniEnv(), activity.get());
 }
 
 void JniSupport::onBackPressed() {
     FakeJni::LocalFrame frame(vm);
-    auto returnPressed = activity->getClass().getMethod("()V", "nativeBackPressed");
+    auto &returnPressed = JniMethods::get(JniMethod::MainActivityBackPressed);
     if(returnPressed)
         returnPressed->invoke(frame.getJniEnv(), activity.get());
 }
@@ -37,6 +37,9 @@ private:
 
     void registerJniClasses();
 
+    template <class... T>
+    void registerLazyClasses();
+
     void registerNatives(std::shared_ptr<FakeJni::JClass const> clazz, std::vector<NativeEntry> entries,
                          void *(*symResolver)(const char *));
 
@@ -49,6 +52,8 @@ public:
                    void *stbiLoadFromMemory, void *stbiImageFree);
 
     void importFile(std::string path);
+    // Deletes the temporary copies of imported files, the game may still read them until it exits
+    static void removeImportedFiles();
 
     void sendUri(std::string uri);
 
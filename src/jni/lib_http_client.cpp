@@ -1,11 +1,20 @@
 #include "lib_http_client.h"
 #include "../util.h"
 #include <log.h>
+#include "lib_http_client_engine.h"
+#include "lib_http_client_cache.h"
+#include "lib_http_client_ranged.h"
+#include "lib_http_client_recorder.h"
+#include "../network_reachability.h"
+#include "jni_methods.h"
 #include <curl/curl.h>
-#include <thread>
+#include <algorithm>
+#include <stdexcept>
 
 using namespace std::placeholders;
 
+static constexpr size_t maxWriteBufferSize = 1024 * 1024;
+
 bool slist_contains(struct curl_slist *list, const char *str) {
     struct curl_slist *current = list;
     while (current != nullptr) {
@@ -32,7 +41,7 @@ HttpClientRequest::~HttpClientRequest() {
 }
 
 FakeJni::JBoolean HttpClientRequest::isNetworkAvailable(std::shared_ptr<Context> context) {
-    return true;
+    return HttpClientRecorder::mode == HttpClientRecorder::Mode::Replay || NetworkReachability::isOnline();
 }
 
 std::shared_ptr<HttpClientRequest> HttpClientRequest::createClientRequest() {
@@ -43,7 +52,8 @@ void HttpClientRequest::setHttpUrl(std::shared_ptr<FakeJni::JString> url) {
 #ifndef NDEBUG
     Log::trace("HttpClient", "URL: %s", url->asStdString().c_str());
 #endif
-    curl_easy_setopt(curl, CURLOPT_URL, url->asStdString().c_str());
+    this->url = url->asStdString();
+    curl_easy_setopt(curl, CURLOPT_URL, this->url.c_str());
 }
 
 void HttpClientRequest::setHttpMethodAndBody(std::shared_ptr<FakeJni::JString> method,
@@ -60,10 +70,10 @@ void HttpClientRequest::setHttpMethodAndBody(std::shared_ptr<FakeJni::JString> m
         curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, this->method.c_str());
     }
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, HttpClientRequest::write_callback_wrapper_old);
-    this->body = body ? std::vector<char>((char *)body->getArray(), (char *)body->getArray() + body->getSize()) : std::vector<char>{};
-    if(this->body.size()) {
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, this->body.data());
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, this->body.size());
+    this->body = body;
+    if(body && body->getSize()) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->getArray());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)body->getSize());
     }
     auto conttype = contentType->asStdString();
     if(conttype.length() && !slist_contains(header, ("Content-Type: " + conttype).c_str())) {
@@ -72,19 +82,6 @@ void HttpClientRequest::setHttpMethodAndBody(std::shared_ptr<FakeJni::JString> m
     }
 }
 
-static size_t read_callback(char *ptr, size_t size, size_t nmemb, void *userdata) {
-    auto stream = (NativeInputStream *)userdata;
-    try {
-        return stream->Read(ptr, size * nmemb);
-    } catch(...) {
-#ifdef CURL_READFUNC_ABORT
-        return CURL_READFUNC_ABORT;
-#else
-        return 0;
-#endif
-    }
-}
-
 void HttpClientRequest::setHttpMethodAndBody2(std::shared_ptr<FakeJni::JString> method, FakeJni::JLong callHandle, std::shared_ptr<FakeJni::JString> contentType, FakeJni::JLong contentLength) {
     this->method = method->asStdString();
     if (this->method == "GET") {
@@ -99,11 +96,12 @@ void HttpClientRequest::setHttpMethodAndBody2(std::shared_ptr<FakeJni::JString>
         curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, this->method.c_str());
     }
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, HttpClientRequest::write_callback_wrapper);
+    streamResponse = true;
 
     if(contentLength > 0) {
-        this->inputStream = std::make_shared<NativeInputStream>(callHandle);
-        curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_callback);
-        curl_easy_setopt(curl, CURLOPT_READDATA, this->inputStream.get());
+        this->inputStream = std::make_shared<NativeInputStream>(callHandle, contentLength);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, HttpClientRequest::read_callback_wrapper);
+        curl_easy_setopt(curl, CURLOPT_READDATA, this);
         if (this->method == "POST") {
             curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) contentLength);
         } else if (this->method == "PUT") {
@@ -134,56 +132,227 @@ void HttpClientRequest::setHttpHeader(std::shared_ptr<FakeJni::JString> name, st
 #ifndef NDEBUG
     Log::trace("HttpClient", "setHttpHeader called, name: %s, value: %s", name->asStdString().c_str(), value->asStdString().c_str());
 #endif
-    header = curl_slist_append(header, (name->asStdString() + ": " + value->asStdString()).c_str());
+    auto headerName = name->asStdString();
+    auto headerValue = value->asStdString();
+    if(strcasecmp(headerName.c_str(), "Authorization") == 0) {
+        authorization = headerValue;
+    } else if(strcasecmp(headerName.c_str(), "If-None-Match") == 0 || strcasecmp(headerName.c_str(), "If-Modified-Since") == 0 || strcasecmp(headerName.c_str(), "Range") == 0) {
+        // The game does its own conditional or partial request, leave it alone
+        cacheBypass = true;
+    } else if(strcasecmp(headerName.c_str(), "Cache-Control") == 0 || strcasecmp(headerName.c_str(), "Pragma") == 0) {
+        std::string lower = headerValue;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        if(lower.find("no-cache") != std::string::npos || lower.find("no-store") != std::string::npos) {
+            cacheBypass = true;
+        }
+    }
+    header = curl_slist_append(header, (headerName + ": " + headerValue).c_str());
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header);
 }
 
 void HttpClientRequest::doRequestAsync(FakeJni::JLong sourceCall) {
     call_handle = sourceCall;
-    auto me = this->shared_from_this();
+    auto me = std::static_pointer_cast<HttpClientRequest>(this->shared_from_this());
     FakeJni::LocalFrame frame;
-    auto&& jvm = &frame.getJniEnv().getVM();
-    std::thread([=]() {
-        FakeJni::JniEnvContext ctx(*jvm);
-        try {
-            auto anotherme = me;
-            auto ret = curl_easy_perform(curl);
-            long response_code;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-            FakeJni::LocalFrame frame;
-            if(ret == CURLE_OK) {
+    auto &jvm = frame.getJniEnv().getVM();
+    if(HttpClientRecorder::mode == HttpClientRecorder::Mode::Replay) {
+        auto exchange = std::make_shared<HttpExchange>();
+        HttpClientEngine::getInstance().start(jvm);
+        if(!HttpClientRecorder::replay(method, url, *exchange)) {
+            Log::warn("HttpClient", "No recording for %s %s", method.empty() ? "GET" : method.c_str(), url.c_str());
+            HttpClientEngine::getInstance().post([me]() {
+                me->sendRequestFailed(true);
+            });
+            return;
+        }
+        HttpClientRecorder::schedule(*exchange, [me, exchange]() {
+            me->sendResponse(exchange->status, std::move(exchange->responseHeaders), exchange->responseBody);
+        });
+        return;
+    }
+    // Recordings should contain every exchange, not cache hits
+    if((method.empty() || method == "GET") && !inputStream && !cacheBypass && HttpClientRecorder::mode == HttpClientRecorder::Mode::Off) {
+        auto &cache = HttpClientCache::getInstance();
+        cacheKey = HttpClientCache::makeKey(url, authorization);
+        HttpClientCache::Validators validators;
+        if(cache.find(cacheKey, getRequestHeaders(), validators)) {
+            if(validators.fresh) {
+                cache.stats.hits++;
+                auto &engine = HttpClientEngine::getInstance();
+                engine.start(jvm);
+                engine.post([me, &jvm]() {
+                    if(!me->sendCachedResponse()) {
+                        // The entry vanished from disk, fetch it again
+                        HttpClientEngine::getInstance().submit(jvm, me->curl, [me](CURLcode ret) {
+                            me->onRequestDone(ret);
+                        });
+                    }
+                });
+                return;
+            }
+            if(!validators.etag.empty() || !validators.lastModified.empty()) {
+                if(!validators.etag.empty()) {
+                    header = curl_slist_append(header, ("If-None-Match: " + validators.etag).c_str());
+                }
+                if(!validators.lastModified.empty()) {
+                    header = curl_slist_append(header, ("If-Modified-Since: " + validators.lastModified).c_str());
+                }
+                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header);
+                cacheRevalidating = true;
+            }
+        } else {
+            cache.stats.misses++;
+        }
 #ifndef NDEBUG
-                Log::trace("HttpClient", "Response: code: %ld", response_code);
+        Log::trace("HttpClient", "Cache: %llu hits, %llu misses, %llu revalidations, %llu stores, %llu evictions", (unsigned long long)cache.stats.hits, (unsigned long long)cache.stats.misses,
+                   (unsigned long long)cache.stats.revalidations, (unsigned long long)cache.stats.stores, (unsigned long long)cache.stats.evictions);
 #endif
-                auto method = getClass().getMethod("(JLcom/xbox/httpclient/HttpClientResponse;)V", "OnRequestCompleted");
-                method->invoke(frame.getJniEnv(), this, sourceCall, frame.getJniEnv().createLocalReference(std::make_shared<HttpClientResponse>(sourceCall, response_code, response, headers)));
-            } else {
-                // Detect if https://github.com/microsoft/libHttpClient/commit/bea2069547e6d480342476cf328b651584e2ada5 is compiled into the binary
-                if(NetworkObserver::getDescriptor()->getMethod("(Ljava/lang/String;)V", "Log")) {
-                    auto method = getClass().getMethod("(JLjava/lang/String;Ljava/lang/String;Ljava/lang/String;Z)V", "OnRequestFailed");
-                    method->invoke(frame.getJniEnv(), this, sourceCall, frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("Error")),
-                                   frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("")),
-                                   frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("")),
-                                   ret == CURLE_COULDNT_RESOLVE_PROXY || ret == CURLE_COULDNT_RESOLVE_HOST || ret == CURLE_COULDNT_CONNECT);
+    }
+    if(!NetworkReachability::isOnline()) {
+        // Waiting for dns or connect timeouts only delays the game's offline handling
+        auto &engine = HttpClientEngine::getInstance();
+        engine.start(jvm);
+        engine.post([me]() {
+            me->sendRequestFailed(true);
+        });
+        return;
+    }
+    HttpClientEngine::getInstance().submit(jvm, curl, [me](CURLcode ret) {
+        me->onRequestDone(ret);
+    });
+}
+
+bool HttpClientRequest::sendCachedResponse() {
+    long status;
+    std::vector<ResponseHeader> cachedHeaders;
+    std::vector<char> cachedBody;
+    if(!HttpClientCache::getInstance().load(cacheKey, status, cachedHeaders, cachedBody)) {
+        return false;
+    }
+    // Nothing gets stored again from a cached response
+    cacheKey = 0;
+    sendResponse(status, std::move(cachedHeaders), cachedBody);
+    return true;
+}
+
+void HttpClientRequest::sendResponse(long status, std::vector<ResponseHeader> responseHeaders, const std::vector<char> &responseBody) {
+    FakeJni::LocalFrame frame;
+    std::vector<signed char> legacyBody;
+    if(streamResponse) {
+        auto stream = std::make_shared<NativeOutputStream>(call_handle);
+        for(size_t offset = 0; offset < responseBody.size(); offset += maxWriteBufferSize) {
+            size_t length = std::min(responseBody.size() - offset, maxWriteBufferSize);
+            if(!writeBuffer || writeBuffer->getSize() < length) {
+                writeBuffer = std::make_shared<FakeJni::JByteArray>(length);
+            }
+            memcpy(writeBuffer->getArray(), responseBody.data() + offset, length);
+            stream->Write(writeBuffer, length);
+        }
+    } else {
+        legacyBody.assign(responseBody.begin(), responseBody.end());
+    }
+    auto &method = JniMethods::get(JniMethod::HttpClientRequestCompleted);
+    method->invoke(frame.getJniEnv(), this, call_handle, frame.getJniEnv().createLocalReference(std::make_shared<HttpClientResponse>(call_handle, status, std::move(legacyBody), std::move(responseHeaders))));
+}
+
+std::vector<ResponseHeader> HttpClientRequest::getRequestHeaders() const {
+    std::vector<ResponseHeader> requestHeaders;
+    for(auto current = header; current; current = current->next) {
+        std::string line = current->data;
+        auto location = line.find(':');
+        if(location != std::string::npos) {
+            auto name = line.substr(0, location);
+            auto value = line.substr(location + 1);
+            trim(name);
+            trim(value);
+            requestHeaders.emplace_back(name, value);
+        }
+    }
+    return requestHeaders;
+}
+
+void HttpClientRequest::recordExchange(long status) {
+    HttpExchange exchange;
+    exchange.method = method;
+    exchange.url = url;
+    exchange.requestHeaders = getRequestHeaders();
+    if(body) {
+        exchange.requestBody.assign((char *)body->getArray(), (char *)body->getArray() + body->getSize());
+    }
+    exchange.status = status;
+    exchange.responseHeaders = headers;
+    if(streamResponse) {
+        exchange.truncated = responseCopyOverflow;
+        exchange.responseBody = std::move(responseCopy);
+    } else {
+        exchange.responseBody.assign(response.begin(), response.end());
+    }
+    curl_off_t total = 0;
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    exchange.durationMs = total / 1000;
+    HttpClientRecorder::record(exchange);
+}
+
+void HttpClientRequest::onRequestDone(int ret) {
+    FakeJni::LocalFrame frame;
+    try {
+        long response_code;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+        if(ret == CURLE_WRITE_ERROR && rangedLength) {
+            // Too large to cache anyway
+            cacheKey = 0;
+            startRangedDownload();
+            return;
+        }
+        if(ret == CURLE_OK) {
+#ifndef NDEBUG
+            Log::trace("HttpClient", "Response: code: %ld", response_code);
+#endif
+            auto &cache = HttpClientCache::getInstance();
+            if(response_code == 304 && cacheRevalidating) {
+                cache.stats.revalidations++;
+                cache.refresh(cacheKey, headers);
+                headers.clear();
+                if(!sendCachedResponse()) {
+                    sendRequestFailed(false);
+                }
+                return;
+            }
+            if(response_code == 200 && cacheKey && !responseCopyOverflow && HttpClientCache::isStorable(headers, !authorization.empty())) {
+                if(streamResponse) {
+                    cache.store(cacheKey, response_code, headers, getRequestHeaders(), responseCopy);
                 } else {
-                    auto method = getClass().getMethod("(JLjava/lang/String;)V", "OnRequestFailed");
-                    method->invoke(frame.getJniEnv(), this, sourceCall, frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("Error")));
+                    cache.store(cacheKey, response_code, headers, getRequestHeaders(), std::vector<char>(response.begin(), response.end()));
                 }
             }
-        } catch(...) {
-            FakeJni::LocalFrame frame(*jvm);
-            if(NetworkObserver::getDescriptor()->getMethod("(Ljava/lang/String;)V", "Log")) {
-                auto method = getClass().getMethod("(JLjava/lang/String;Ljava/lang/String;Ljava/lang/String;Z)V", "OnRequestFailed");
-                method->invoke(frame.getJniEnv(), this, sourceCall, frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("Error")),
-                               frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("")),
-                               frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("")),
-                               false);
-            } else {
-                auto method = getClass().getMethod("(JLjava/lang/String;)V", "OnRequestFailed");
-                method->invoke(frame.getJniEnv(), this, sourceCall, frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("Error")));
+            if(HttpClientRecorder::mode == HttpClientRecorder::Mode::Record) {
+                recordExchange(response_code);
             }
+            responseCopy = {};
+            auto &method = JniMethods::get(JniMethod::HttpClientRequestCompleted);
+            flushWriteBuffer();
+            method->invoke(frame.getJniEnv(), this, call_handle, frame.getJniEnv().createLocalReference(std::make_shared<HttpClientResponse>(call_handle, response_code, std::move(response), std::move(headers))));
+        } else {
+            sendRequestFailed(ret == CURLE_COULDNT_RESOLVE_PROXY || ret == CURLE_COULDNT_RESOLVE_HOST || ret == CURLE_COULDNT_CONNECT);
         }
-    }).detach();
+    } catch(...) {
+        sendRequestFailed(false);
+    }
+}
+
+void HttpClientRequest::sendRequestFailed(bool networkError) {
+    FakeJni::LocalFrame frame;
+    // Detect if https://github.com/microsoft/libHttpClient/commit/bea2069547e6d480342476cf328b651584e2ada5 is compiled into the binary
+    if(JniMethods::get(JniMethod::NetworkObserverLog)) {
+        auto &method = JniMethods::get(JniMethod::HttpClientRequestFailedWithDetails);
+        method->invoke(frame.getJniEnv(), this, call_handle, frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("Error")),
+                       frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("")),
+                       frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("")),
+                       networkError);
+    } else {
+        auto &method = JniMethods::get(JniMethod::HttpClientRequestFailed);
+        method->invoke(frame.getJniEnv(), this, call_handle, frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>("Error")));
+    }
 }
 
 FakeJni::JInt HttpClientResponse::getNumHeaders() {
@@ -214,15 +383,54 @@ FakeJni::JInt HttpClientResponse::getResponseCode() {
 }
 
 HttpClientResponse::HttpClientResponse(FakeJni::JLong call_handle, int response_code, std::vector<signed char> body, std::vector<ResponseHeader> headers) : response_code(response_code),
-                                                                                                                                                            body(body),
-                                                                                                                                                            headers(headers),
+                                                                                                                                                            body(std::move(body)),
+                                                                                                                                                            headers(std::move(headers)),
                                                                                                                                                             call_handle(call_handle) {}
 
 size_t HttpClientRequest::write_callback(char *ptr, size_t size, size_t nmemb) {
     try {
-        auto byteArray = std::make_shared<FakeJni::JByteArray>(nmemb);
-        memcpy(byteArray->getArray(), ptr, nmemb);
-        std::make_shared<NativeOutputStream>(call_handle)->WriteAll(byteArray);
+        if(!writeBuffer && shouldDownloadRanged()) {
+            // Aborts this transfer, onRequestDone continues with parallel ranges
+            return 0;
+        }
+        if(!writeBuffer) {
+            // Size the buffer for the whole body when it is small, otherwise stream it in 1 MB pieces
+            curl_off_t contentLength = -1;
+            curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+            size_t capacity = contentLength > 0 ? std::min((size_t)contentLength, maxWriteBufferSize) : maxWriteBufferSize / 4;
+            writeBuffer = std::make_shared<FakeJni::JByteArray>(std::max(capacity, nmemb));
+            outputStream = std::make_shared<NativeOutputStream>(call_handle);
+            // The headers are complete now, a response that is never stored needs no copy of its body
+            if(cacheKey) {
+                long status = 0;
+                curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+                if(status != 304 && (status != 200 || !HttpClientCache::isStorable(headers, !authorization.empty()))) {
+                    cacheKey = 0;
+                }
+            }
+        }
+        if(bodyStreamFailed) {
+            throw std::runtime_error("nativeWrite failed");
+        }
+        if(writeBufferUsed + nmemb > writeBuffer->getSize()) {
+            if(writeBufferUsed) {
+                // curl hands this chunk in again once the worker delivered the buffer and resumed the transfer
+                resumeAfter([this]() { flushWriteBuffer(); });
+                return CURL_WRITEFUNC_PAUSE;
+            }
+            writeBuffer = std::make_shared<FakeJni::JByteArray>(nmemb);
+        }
+        bool recording = HttpClientRecorder::mode == HttpClientRecorder::Mode::Record;
+        if((cacheKey || recording) && !responseCopyOverflow) {
+            if(responseCopy.size() + nmemb > (recording ? HttpClientRecorder::maxBodySize : HttpClientCache::maxEntrySize)) {
+                responseCopyOverflow = true;
+                responseCopy = {};
+            } else {
+                responseCopy.insert(responseCopy.end(), ptr, ptr + nmemb);
+            }
+        }
+        memcpy((char *)writeBuffer->getArray() + writeBufferUsed, ptr, nmemb);
+        writeBufferUsed += nmemb;
         return size * nmemb;
     } catch(...) {
 #ifdef CURL_WRITEFUNC_ERROR
@@ -233,6 +441,79 @@ size_t HttpClientRequest::write_callback(char *ptr, size_t size, size_t nmemb) {
     }
 }
 
+size_t HttpClientRequest::read_callback(char *ptr, size_t size, size_t nmemb) {
+    try {
+        if(bodyStreamFailed) {
+            throw std::runtime_error("nativeRead failed");
+        }
+        if(inputStream->needsFill()) {
+            resumeAfter([this]() { inputStream->fill(); });
+            return CURL_READFUNC_PAUSE;
+        }
+        return inputStream->Read(ptr, size * nmemb);
+    } catch(...) {
+#ifdef CURL_READFUNC_ABORT
+        return CURL_READFUNC_ABORT;
+#else
+        return 0;
+#endif
+    }
+}
+
+// Runs on the event loop, the transfer is paused so its buffers belong to the worker until it resumes
+void HttpClientRequest::resumeAfter(std::function<void()> task) {
+    auto me = std::static_pointer_cast<HttpClientRequest>(this->shared_from_this());
+    HttpClientEngine::getInstance().post([me, task = std::move(task)]() {
+        try {
+            task();
+        } catch(...) {
+            me->bodyStreamFailed = true;
+        }
+        HttpClientEngine::getInstance().resume(me->curl);
+    });
+}
+
+bool HttpClientRequest::shouldDownloadRanged() {
+    long responseCode = 0;
+    curl_off_t contentLength = -1;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+    if(HttpClientRecorder::mode != HttpClientRecorder::Mode::Off || responseCode != 200 || contentLength < HttpClientRangedDownload::minSize || !(method.empty() || method == "GET") || inputStream) {
+        return false;
+    }
+    for(auto &&h : headers) {
+        if(strcasecmp(h.name.c_str(), "Accept-Ranges") == 0 && strcasecmp(h.value.c_str(), "bytes") == 0) {
+            rangedLength = contentLength;
+            return true;
+        }
+    }
+    return false;
+}
+
+void HttpClientRequest::startRangedDownload() {
+    auto me = std::static_pointer_cast<HttpClientRequest>(this->shared_from_this());
+    char *effectiveUrl = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effectiveUrl);
+    FakeJni::LocalFrame frame;
+    auto download = std::make_shared<HttpClientRangedDownload>(frame.getJniEnv().getVM(), curl, effectiveUrl ? effectiveUrl : url, rangedLength, std::make_shared<NativeOutputStream>(call_handle), [me](bool ok, bool networkError) {
+        if(!ok) {
+            me->sendRequestFailed(networkError);
+            return;
+        }
+        FakeJni::LocalFrame frame;
+        auto &method = JniMethods::get(JniMethod::HttpClientRequestCompleted);
+        method->invoke(frame.getJniEnv(), me.get(), me->call_handle, frame.getJniEnv().createLocalReference(std::make_shared<HttpClientResponse>(me->call_handle, 200, std::vector<signed char>(), std::move(me->headers))));
+    });
+    download->start();
+}
+
+void HttpClientRequest::flushWriteBuffer() {
+    if(writeBufferUsed) {
+        outputStream->Write(writeBuffer, writeBufferUsed);
+        writeBufferUsed = 0;
+    }
+}
+
 // Unused in 1.18.30+, kept for compatibility with older versions
 size_t HttpClientRequest::write_callback_old(char *ptr, size_t size, size_t nmemb) {
     response.insert(response.end(), ptr, ptr + nmemb);
@@ -252,26 +533,43 @@ size_t HttpClientRequest::header_callback(char *buffer, size_t size, size_t nite
     return size * nitems;
 }
 
-NativeInputStream::NativeInputStream(FakeJni::JLong call_handle) : call_handle(call_handle) {
+static constexpr FakeJni::JLong maxReadBufferSize = 1024 * 1024;
+
+NativeInputStream::NativeInputStream(FakeJni::JLong call_handle, FakeJni::JLong contentLength) : call_handle(call_handle) {
+    readBuffer = std::make_shared<FakeJni::JByteArray>((size_t)std::max<FakeJni::JLong>(1, std::min(contentLength, maxReadBufferSize)));
 }
 
-size_t NativeInputStream::Read(void *buffer, size_t size) {
+void NativeInputStream::fill() {
     FakeJni::LocalFrame frame;
-    auto method = getClass().getMethod("(JJ[BJJ)I", "nativeRead");
-    auto buf = std::make_shared<FakeJni::JByteArray>((size_t)std::numeric_limits<jsize>::max() < size ? std::numeric_limits<jsize>::max() : (jsize)size);
-    jvalue ret = method->invoke(frame.getJniEnv(), this, call_handle, offset, frame.getJniEnv().createLocalReference(buf), (FakeJni::JLong)0, (FakeJni::JLong)buf->getSize());
-    if(ret.i != -1) {
-        memcpy(buffer, buf->getArray(), ret.i);
+    auto &method = JniMethods::get(JniMethod::NativeInputStreamRead);
+    jvalue ret = method->invoke(frame.getJniEnv(), this, call_handle, offset, frame.getJniEnv().createLocalReference(readBuffer), (FakeJni::JLong)0, (FakeJni::JLong)readBuffer->getSize());
+    readBufferPos = 0;
+    // curl ends the upload on a read of nothing, asking the game again would only spin
+    if(ret.i <= 0) {
+        readBufferEnd = 0;
+        endOfStream = true;
+    } else {
+        readBufferEnd = ret.i;
         offset += ret.i;
     }
-    return ret.i;
+}
+
+size_t NativeInputStream::Read(void *buffer, size_t size) {
+    size_t length = std::min(size, readBufferEnd - readBufferPos);
+    memcpy(buffer, (char *)readBuffer->getArray() + readBufferPos, length);
+    readBufferPos += length;
+    return length;
 }
 
 NativeOutputStream::NativeOutputStream(FakeJni::JLong call_handle) : call_handle(call_handle) {
 }
 
 void NativeOutputStream::WriteAll(std::shared_ptr<FakeJni::JByteArray> data) {
+    Write(data, data->getSize());
+}
+
+void NativeOutputStream::Write(std::shared_ptr<FakeJni::JByteArray> data, FakeJni::JInt length) {
     FakeJni::LocalFrame frame;
-    auto method = getClass().getMethod("(J[BII)V", "nativeWrite");
-    method->invoke(frame.getJniEnv(), this, call_handle, frame.getJniEnv().createLocalReference(data), (FakeJni::JInt)0, (FakeJni::JInt)data->getSize());
+    auto &method = JniMethods::get(JniMethod::NativeOutputStreamWrite);
+    method->invoke(frame.getJniEnv(), this, call_handle, frame.getJniEnv().createLocalReference(data), (FakeJni::JInt)0, length);
 }
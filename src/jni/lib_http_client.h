@@ -3,7 +3,9 @@
 #include <fake-jni/fake-jni.h>
 #include "main_activity.h"
 #include <log.h>
+#include <curl/curl.h>
 
+#include <functional>
 #include <utility>
 
 class ResponseHeader {
@@ -13,13 +15,26 @@ public:
     std::string value;
 };
 
+class NativeOutputStream;
+
 class NativeInputStream : public FakeJni::JObject {
     FakeJni::JLong call_handle;
     FakeJni::JLong offset = 0;
+    // Reused for every nativeRead, reads ahead of curl's smaller requests
+    std::shared_ptr<FakeJni::JByteArray> readBuffer;
+    size_t readBufferPos = 0;
+    size_t readBufferEnd = 0;
+    bool endOfStream = false;
 
 public:
     DEFINE_CLASS_NAME("com/xbox/httpclient/HttpClientRequestBody/00024NativeInputStream")
-    NativeInputStream(FakeJni::JLong call_handle);
+    NativeInputStream(FakeJni::JLong call_handle, FakeJni::JLong contentLength);
+    // The buffer is drained and the game has more, fill has to run before the next Read
+    bool needsFill() const {
+        return readBufferPos == readBufferEnd && !endOfStream;
+    }
+    // Calls nativeRead, only from a thread that may call into the game
+    void fill();
     size_t Read(void *buffer, size_t size);
 };
 
@@ -47,6 +62,10 @@ public:
         auto *self = static_cast<HttpClientRequest *>(userdata);
         return self->write_callback(ptr, size, nmemb);
     }
+    static size_t read_callback_wrapper(char *ptr, size_t size, size_t nmemb, void *userdata) {
+        auto *self = static_cast<HttpClientRequest *>(userdata);
+        return self->read_callback(ptr, size, nmemb);
+    }
     static size_t header_callback_wrapper(char *ptr, size_t size, size_t nmemb, void *userdata) {
         auto *self = static_cast<HttpClientRequest *>(userdata);
         return self->header_callback(ptr, size, nmemb);
@@ -57,13 +76,42 @@ private:
     struct curl_slist *header = nullptr;
     std::vector<signed char> response;
     std::vector<ResponseHeader> headers;
-    std::vector<char> body;
+    // Kept alive so curl can send the array's storage directly
+    std::shared_ptr<FakeJni::JByteArray> body;
     std::string method;
     FakeJni::JLong call_handle;
+    // Response chunks are coalesced here before crossing into the game via nativeWrite
+    std::shared_ptr<FakeJni::JByteArray> writeBuffer;
+    size_t writeBufferUsed = 0;
+    std::shared_ptr<NativeOutputStream> outputStream;
+    // nativeRead or nativeWrite threw on a worker, the paused transfer is aborted once it resumes
+    bool bodyStreamFailed = false;
+    // Response cache state, a cacheKey of 0 means the response is not cached, responseCopy is also used by --http-record
+    std::string url;
+    std::string authorization;
+    bool cacheBypass = false;
+    bool streamResponse = false;
+    bool cacheRevalidating = false;
+    bool responseCopyOverflow = false;
+    uint64_t cacheKey = 0;
+    std::vector<char> responseCopy;
+    // Set when the single transfer was stopped in favour of a ranged download
+    curl_off_t rangedLength = 0;
 
     size_t write_callback_old(char *ptr, size_t size, size_t nmemb);
     size_t write_callback(char *ptr, size_t size, size_t nmemb);
+    size_t read_callback(char *ptr, size_t size, size_t nmemb);
+    void resumeAfter(std::function<void()> task);
     size_t header_callback(char *buffer, size_t size, size_t nitems);
+    void flushWriteBuffer();
+    void onRequestDone(int ret);
+    bool sendCachedResponse();
+    void sendResponse(long status, std::vector<ResponseHeader> responseHeaders, const std::vector<char> &responseBody);
+    void recordExchange(long status);
+    std::vector<ResponseHeader> getRequestHeaders() const;
+    bool shouldDownloadRanged();
+    void startRangedDownload();
+    void sendRequestFailed(bool networkError);
 };
 
 class HttpClientResponse : public FakeJni::JObject {
@@ -93,6 +141,7 @@ public:
     DEFINE_CLASS_NAME("com/xbox/httpclient/HttpClientResponse/00024NativeOutputStream")
     NativeOutputStream(FakeJni::JLong call_handle);
     void WriteAll(std::shared_ptr<FakeJni::JByteArray> data);
+    void Write(std::shared_ptr<FakeJni::JByteArray> data, FakeJni::JInt length);
 };
 
 class NetworkObserver : public FakeJni::JObject {
@@ -0,0 +1,292 @@
+#include "lib_http_client_cache.h"
+#include "lib_http_client.h"
+#include <mcpelauncher/path_helper.h>
+#include <FileUtil.h>
+#include <log.h>
+#include <curl/curl.h>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static constexpr uint32_t indexMagic = 0x48434331;  // HCC1
+static constexpr uint32_t indexVersion = 2;
+
+HttpClientCache::Stats HttpClientCache::stats;
+
+HttpClientCache &HttpClientCache::getInstance() {
+    static HttpClientCache instance;
+    return instance;
+}
+
+HttpClientCache::HttpClientCache() {
+    directory = PathHelper::getCacheDirectory() + "http/";
+    FileUtil::mkdirRecursive(directory);
+    auto indexPath = directory + "index";
+    size_t indexSize = sizeof(IndexHeader) + sizeof(IndexEntry) * maxEntries;
+    int fd = open(indexPath.data(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd == -1 || ftruncate(fd, indexSize) != 0) {
+        Log::error("HttpClientCache", "Failed to open %s, the http cache is disabled", indexPath.data());
+        if(fd != -1) {
+            close(fd);
+        }
+        return;
+    }
+    auto mapped = mmap(nullptr, indexSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED) {
+        Log::error("HttpClientCache", "Failed to map %s, the http cache is disabled", indexPath.data());
+        return;
+    }
+    header = (IndexHeader *)mapped;
+    entries = (IndexEntry *)(header + 1);
+    if(header->magic != indexMagic || header->version != indexVersion) {
+        memset(mapped, 0, indexSize);
+        header->magic = indexMagic;
+        header->version = indexVersion;
+    }
+}
+
+uint64_t HttpClientCache::makeKey(const std::string &url, const std::string &authorization) {
+    // FNV-1a, a key of 0 marks a free index slot
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&](const std::string &s) {
+        for(unsigned char c : s) {
+            hash = (hash ^ c) * 0x100000001b3ull;
+        }
+    };
+    mix(url);
+    mix("\n");
+    mix(authorization);
+    return hash ? hash : 1;
+}
+
+static std::string lowerCase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+static const std::string *findHeader(const std::vector<ResponseHeader> &headers, const char *name) {
+    for(auto &&h : headers) {
+        if(strcasecmp(h.name.data(), name) == 0) {
+            return &h.value;
+        }
+    }
+    return nullptr;
+}
+
+bool HttpClientCache::isStorable(const std::vector<ResponseHeader> &headers, bool authorized) {
+    auto cacheControl = findHeader(headers, "Cache-Control");
+    if(cacheControl && lowerCase(*cacheControl).find("no-store") != std::string::npos) {
+        return false;
+    }
+    // RFC 9111 3.5, the cache files are not encrypted so responses to signed in requests stay off disk unless shared anyway
+    if(authorized && (!cacheControl || lowerCase(*cacheControl).find("public") == std::string::npos)) {
+        return false;
+    }
+    // Vary: * never matches a later request, other names have to fit into the index entry
+    if(auto vary = findHeader(headers, "Vary"); vary && (vary->find('*') != std::string::npos || vary->size() >= sizeof(IndexEntry::vary))) {
+        return false;
+    }
+    return cacheControl || findHeader(headers, "Expires") || findHeader(headers, "ETag") || findHeader(headers, "Last-Modified");
+}
+
+void HttpClientCache::logStats() {
+    if(stats.hits + stats.misses + stats.revalidations == 0) {
+        return;
+    }
+    Log::info("HttpClientCache", "%llu hits, %llu misses, %llu revalidations, %llu stores, %llu evictions", (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+              (unsigned long long)stats.revalidations, (unsigned long long)stats.stores, (unsigned long long)stats.evictions);
+}
+
+// RFC 9111 4.2, the lifetime counts from when the origin generated the response, not from when it arrived here
+int64_t HttpClientCache::computeExpires(const std::vector<ResponseHeader> &headers, int64_t now) {
+    int64_t date = now;
+    if(auto value = findHeader(headers, "Date")) {
+        auto time = curl_getdate(value->data(), nullptr);
+        if(time > 0) {
+            date = time;
+        }
+    }
+    int64_t age = std::max<int64_t>(now - date, 0);
+    if(auto value = findHeader(headers, "Age")) {
+        age = std::max<int64_t>(age, atoll(value->data()));
+    }
+    if(auto cacheControl = findHeader(headers, "Cache-Control")) {
+        auto value = lowerCase(*cacheControl);
+        if(value.find("no-cache") != std::string::npos) {
+            return 0;
+        }
+        auto maxAge = value.find("max-age=");
+        if(maxAge != std::string::npos) {
+            return now + atoll(value.data() + maxAge + 8) - age;
+        }
+    }
+    if(auto expires = findHeader(headers, "Expires")) {
+        auto time = curl_getdate(expires->data(), nullptr);
+        return time > 0 ? now + (time - date) - age : 0;
+    }
+    // Only validators, every use needs a conditional request
+    return 0;
+}
+
+uint64_t HttpClientCache::hashVaryValues(const std::string &vary, const std::vector<ResponseHeader> &requestHeaders) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(size_t i = 0; i < vary.size();) {
+        auto end = std::min(vary.find(',', i), vary.size());
+        auto name = vary.substr(i, end - i);
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        i = end + 1;
+        if(name.empty()) {
+            continue;
+        }
+        // A header the request did not send hashes differently from one sent empty
+        auto value = findHeader(requestHeaders, name.data());
+        auto field = lowerCase(name) + (value ? ":" + *value : "") + "\n";
+        for(unsigned char c : field) {
+            hash = (hash ^ c) * 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+HttpClientCache::IndexEntry *HttpClientCache::findEntry(uint64_t key) {
+    if(!entries) {
+        return nullptr;
+    }
+    for(size_t i = 0; i < maxEntries; i++) {
+        if(entries[i].key == key) {
+            return &entries[i];
+        }
+    }
+    return nullptr;
+}
+
+std::string HttpClientCache::entryPath(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+    return directory + name;
+}
+
+void HttpClientCache::evict(IndexEntry &entry) {
+    unlink(entryPath(entry.key).data());
+    header->totalSize -= std::min(header->totalSize, entry.size);
+    memset(&entry, 0, sizeof(entry));
+    stats.evictions++;
+}
+
+bool HttpClientCache::find(uint64_t key, const std::vector<ResponseHeader> &requestHeaders, Validators &validators) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = findEntry(key);
+    if(!entry) {
+        return false;
+    }
+    if(entry->vary[0] && hashVaryValues(std::string(entry->vary, strnlen(entry->vary, sizeof(entry->vary))), requestHeaders) != entry->varyHash) {
+        return false;
+    }
+    validators.fresh = entry->expires > time(nullptr);
+    validators.etag = std::string(entry->etag, strnlen(entry->etag, sizeof(entry->etag)));
+    validators.lastModified = std::string(entry->lastModified, strnlen(entry->lastModified, sizeof(entry->lastModified)));
+    return true;
+}
+
+bool HttpClientCache::load(uint64_t key, long &status, std::vector<ResponseHeader> &headers, std::vector<char> &body) {
+    std::ifstream file(entryPath(key), std::ios::binary);
+    std::string line;
+    if(!file || !std::getline(file, line)) {
+        return false;
+    }
+    status = atol(line.data());
+    while(std::getline(file, line) && !line.empty()) {
+        auto location = line.find(": ");
+        if(location != std::string::npos) {
+            headers.emplace_back(line.substr(0, location), line.substr(location + 2));
+        }
+    }
+    auto start = file.tellg();
+    file.seekg(0, std::ios::end);
+    body.resize(file.tellg() - start);
+    file.seekg(start);
+    if(!file.read(body.data(), body.size())) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if(auto entry = findEntry(key)) {
+        entry->lastAccess = time(nullptr);
+    }
+    return true;
+}
+
+void HttpClientCache::store(uint64_t key, long status, const std::vector<ResponseHeader> &headers, const std::vector<ResponseHeader> &requestHeaders, const std::vector<char> &body) {
+    if(!entries || body.size() > maxEntrySize) {
+        return;
+    }
+    auto path = entryPath(key);
+    {
+        std::ofstream file(path + ".tmp", std::ios::binary | std::ios::trunc);
+        file << status << '\n';
+        for(auto &&h : headers) {
+            file << h.name << ": " << h.value << '\n';
+        }
+        file << '\n';
+        file.write(body.data(), body.size());
+        if(!file) {
+            unlink((path + ".tmp").data());
+            return;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    rename((path + ".tmp").data(), path.data());
+    auto entry = findEntry(key);
+    if(entry) {
+        header->totalSize -= std::min(header->totalSize, entry->size);
+    } else {
+        entry = findEntry(0);
+    }
+    // Least recently used entries make room for the new one
+    while(!entry || header->totalSize + body.size() > maxTotalSize) {
+        IndexEntry *oldest = nullptr;
+        for(size_t i = 0; i < maxEntries; i++) {
+            if(entries[i].key && entries[i].key != key && (!oldest || entries[i].lastAccess < oldest->lastAccess)) {
+                oldest = &entries[i];
+            }
+        }
+        if(!oldest) {
+            break;
+        }
+        evict(*oldest);
+        if(!entry) {
+            entry = oldest;
+        }
+    }
+    if(!entry) {
+        return;
+    }
+    auto now = time(nullptr);
+    entry->key = key;
+    entry->size = body.size();
+    entry->expires = computeExpires(headers, now);
+    entry->lastAccess = now;
+    auto etag = findHeader(headers, "ETag");
+    snprintf(entry->etag, sizeof(entry->etag), "%s", etag && etag->size() < sizeof(entry->etag) ? etag->data() : "");
+    auto lastModified = findHeader(headers, "Last-Modified");
+    snprintf(entry->lastModified, sizeof(entry->lastModified), "%s", lastModified && lastModified->size() < sizeof(entry->lastModified) ? lastModified->data() : "");
+    auto vary = findHeader(headers, "Vary");
+    snprintf(entry->vary, sizeof(entry->vary), "%s", vary ? vary->data() : "");
+    entry->varyHash = vary ? hashVaryValues(*vary, requestHeaders) : 0;
+    header->totalSize += body.size();
+    stats.stores++;
+}
+
+void HttpClientCache::refresh(uint64_t key, const std::vector<ResponseHeader> &headers) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(auto entry = findEntry(key)) {
+        auto now = time(nullptr);
+        entry->expires = computeExpires(headers, now);
+        entry->lastAccess = now;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ResponseHeader;
+
+// Private on-disk cache for GET responses of lib_http_client, honours Cache-Control, ETag and Last-Modified
+class HttpClientCache {
+public:
+    struct Validators {
+        bool fresh = false;
+        std::string etag;
+        std::string lastModified;
+    };
+
+    struct Stats {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> revalidations{0};
+        std::atomic<uint64_t> stores{0};
+        std::atomic<uint64_t> evictions{0};
+    };
+
+    static HttpClientCache &getInstance();
+    static uint64_t makeKey(const std::string &url, const std::string &authorization);
+    // Whether the response headers allow storing the response at all, responses to requests with credentials only when marked public
+    static bool isStorable(const std::vector<ResponseHeader> &headers, bool authorized);
+    // Logs the counters below, called on exit
+    static void logStats();
+
+    // Index only lookup, no disk io besides the mapped index, an entry stored for other values of its Vary headers is a miss
+    bool find(uint64_t key, const std::vector<ResponseHeader> &requestHeaders, Validators &validators);
+    bool load(uint64_t key, long &status, std::vector<ResponseHeader> &headers, std::vector<char> &body);
+    void store(uint64_t key, long status, const std::vector<ResponseHeader> &headers, const std::vector<ResponseHeader> &requestHeaders, const std::vector<char> &body);
+    // Updates the freshness of an entry after a 304 Not Modified
+    void refresh(uint64_t key, const std::vector<ResponseHeader> &headers);
+
+    static Stats stats;
+
+    static constexpr size_t maxEntrySize = 16 * 1024 * 1024;
+
+private:
+    HttpClientCache();
+
+    struct IndexEntry {
+        uint64_t key;
+        uint64_t size;
+        int64_t expires;
+        int64_t lastAccess;
+        char etag[128];
+        char lastModified[64];
+        // Names from the response's Vary header and a hash of the request's values for them
+        char vary[64];
+        uint64_t varyHash;
+    };
+    struct IndexHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t totalSize;
+    };
+
+    static constexpr size_t maxEntries = 4096;
+    static constexpr uint64_t maxTotalSize = 256 * 1024 * 1024;
+
+    IndexEntry *findEntry(uint64_t key);
+    std::string entryPath(uint64_t key);
+    void evict(IndexEntry &entry);
+    static int64_t computeExpires(const std::vector<ResponseHeader> &headers, int64_t now);
+    static uint64_t hashVaryValues(const std::string &vary, const std::vector<ResponseHeader> &requestHeaders);
+
+    std::mutex mutex;
+    std::string directory;
+    IndexHeader *header = nullptr;
+    IndexEntry *entries = nullptr;
+};
@@ -0,0 +1,186 @@
+#include "lib_http_client_engine.h"
+#include <log.h>
+#include <memory>
+
+HttpClientEngine &HttpClientEngine::getInstance() {
+    static HttpClientEngine instance;
+    return instance;
+}
+
+HttpClientEngine::HttpClientEngine() {
+    multi = curl_multi_init();
+#ifdef CURLPIPE_MULTIPLEX
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+    shareHandle = curl_share_init();
+    curl_share_setopt(shareHandle, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(shareHandle, CURLSHOPT_LOCKFUNC, +[](CURL *, curl_lock_data data, curl_lock_access, void *userptr) {
+        ((HttpClientEngine *)userptr)->shareLocks[data].lock();
+    });
+    curl_share_setopt(shareHandle, CURLSHOPT_UNLOCKFUNC, +[](CURL *, curl_lock_data data, void *userptr) {
+        ((HttpClientEngine *)userptr)->shareLocks[data].unlock();
+    });
+    curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+}
+
+void HttpClientEngine::start(FakeJni::Jvm &jvm) {
+    std::call_once(started, &HttpClientEngine::run, this, std::ref(jvm));
+}
+
+void HttpClientEngine::run(FakeJni::Jvm &jvm) {
+    this->jvm = &jvm;
+    startLoop();
+    for(int i = 0; i < workerCount; i++) {
+        std::thread(&HttpClientEngine::worker, this).detach();
+    }
+}
+
+void HttpClientEngine::share(CURL *easy) {
+    curl_easy_setopt(easy, CURLOPT_SHARE, shareHandle);
+}
+
+void HttpClientEngine::startLoop() {
+    std::call_once(loopStarted, [this]() {
+        std::thread(&HttpClientEngine::loop, this).detach();
+    });
+}
+
+void HttpClientEngine::prewarm(std::vector<std::string> hosts) {
+    for(auto &&host : hosts) {
+        auto easy = curl_easy_init();
+        auto url = "https://" + host + "/";
+        curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+        // A HEAD request leaves the connection in the multi handle's pool, a connect only handle would keep it to itself
+        curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(easy, CURLOPT_TIMEOUT, 10L);
+        // Runs on the worker pool, so only once the game started its first request
+        enqueue(easy, [easy, host](CURLcode res) {
+#ifndef NDEBUG
+            curl_off_t appconnect = 0;
+            curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+            Log::trace("HttpClient", "Prewarmed %s: %s, tls handshake %lld ms", host.c_str(), curl_easy_strerror(res), (long long)appconnect / 1000);
+#else
+            (void)res;
+#endif
+            curl_easy_cleanup(easy);
+        });
+    }
+}
+
+void HttpClientEngine::submit(FakeJni::Jvm &jvm, CURL *easy, std::function<void(CURLcode)> onDone) {
+    start(jvm);
+    enqueue(easy, std::move(onDone));
+}
+
+void HttpClientEngine::enqueue(CURL *easy, std::function<void(CURLcode)> onDone) {
+    startLoop();
+    share(easy);
+    {
+        std::lock_guard<std::mutex> lock(submitLock);
+        submitted.push_back({easy, std::move(onDone)});
+    }
+    curl_multi_wakeup(multi);
+}
+
+void HttpClientEngine::resume(CURL *easy) {
+    {
+        std::lock_guard<std::mutex> lock(submitLock);
+        resumed.push_back(easy);
+    }
+    curl_multi_wakeup(multi);
+}
+
+void HttpClientEngine::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(tasksLock);
+        tasks.emplace_back(std::move(task));
+    }
+    tasksCv.notify_one();
+}
+
+void HttpClientEngine::loop() {
+    // Read and write callbacks create jni arrays, prewarming may start the loop before there is a jvm to attach to.
+    // They never call into the game here, a slow nativeRead or nativeWrite would stall every transfer
+    std::unique_ptr<FakeJni::JniEnvContext> ctx;
+    std::vector<Transfer> incoming;
+    std::vector<CURL *> continued;
+    while(true) {
+        {
+            std::lock_guard<std::mutex> lock(submitLock);
+            incoming.swap(submitted);
+            continued.swap(resumed);
+        }
+        for(auto &&easy : continued) {
+            // A paused transfer can still time out, its handle may be gone by now
+            if(running.count(easy)) {
+                curl_easy_pause(easy, CURLPAUSE_CONT);
+            }
+        }
+        continued.clear();
+        if(!ctx && jvm) {
+            ctx = std::make_unique<FakeJni::JniEnvContext>(*jvm);
+        }
+        for(auto &&transfer : incoming) {
+            auto res = curl_multi_add_handle(multi, transfer.easy);
+            if(res != CURLM_OK) {
+                Log::error("HttpClient", "curl_multi_add_handle failed: %s", curl_multi_strerror(res));
+                post(std::bind(std::move(transfer.onDone), CURLE_FAILED_INIT));
+                continue;
+            }
+            running.emplace(transfer.easy, std::move(transfer.onDone));
+        }
+        incoming.clear();
+
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+        CURLMsg *msg;
+        int remaining = 0;
+        while((msg = curl_multi_info_read(multi, &remaining))) {
+            if(msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            auto easy = msg->easy_handle;
+            auto result = msg->data.result;
+            curl_multi_remove_handle(multi, easy);
+            auto it = running.find(easy);
+            if(it == running.end()) {
+                continue;
+            }
+#ifndef NDEBUG
+            curl_off_t total = 0, appconnect = 0;
+            long connects = 0;
+            curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &total);
+            curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+            curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+            Log::trace("HttpClient", "Request finished in %lld ms, tls handshake %lld ms, new connections %ld", (long long)total / 1000, (long long)appconnect / 1000, connects);
+#endif
+            post(std::bind(std::move(it->second), result));
+            running.erase(it);
+        }
+        curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+    }
+}
+
+void HttpClientEngine::worker() {
+    FakeJni::JniEnvContext ctx(*jvm);
+    while(true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(tasksLock);
+            tasksCv.wait(lock, [this] { return !tasks.empty(); });
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        try {
+            task();
+        } catch(const std::exception &e) {
+            Log::error("HttpClient", "Callback failed: %s", e.what());
+        } catch(...) {
+            Log::error("HttpClient", "Callback failed");
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <fake-jni/fake-jni.h>
+#include <curl/curl.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Runs all lib_http_client transfers on one curl_multi event loop sharing dns, tls sessions and connections
+class HttpClientEngine {
+public:
+    static HttpClientEngine &getInstance();
+
+    // Starts the event loop and worker pool on first use
+    void start(FakeJni::Jvm &jvm);
+
+    // Queues the easy handle on the event loop, onDone is called from a worker thread once the transfer finished
+    void submit(FakeJni::Jvm &jvm, CURL *easy, std::function<void(CURLcode)> onDone);
+    // Runs a task on the worker pool, tasks may call into the jvm
+    void post(std::function<void()> task);
+    // Continues a transfer one of its callbacks paused, from any thread
+    void resume(CURL *easy);
+    // Applies the shared dns / tls session / connection cache to a handle not driven by this engine
+    void share(CURL *easy);
+    // Queues HEAD requests to the hosts so the first requests find warm connections, needs no jvm
+    void prewarm(std::vector<std::string> hosts);
+
+private:
+    HttpClientEngine();
+
+    struct Transfer {
+        CURL *easy;
+        std::function<void(CURLcode)> onDone;
+    };
+
+    void run(FakeJni::Jvm &jvm);
+    void startLoop();
+    void enqueue(CURL *easy, std::function<void(CURLcode)> onDone);
+    void loop();
+    void worker();
+
+    static constexpr int workerCount = 4;
+
+    CURLM *multi;
+    CURLSH *shareHandle;
+    std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+
+    std::atomic<FakeJni::Jvm *> jvm{nullptr};
+    std::once_flag started;
+    std::once_flag loopStarted;
+
+    std::mutex submitLock;
+    std::vector<Transfer> submitted;
+    std::vector<CURL *> resumed;
+    std::unordered_map<CURL *, std::function<void(CURLcode)>> running;
+
+    std::mutex tasksLock;
+    std::condition_variable tasksCv;
+    std::deque<std::function<void()>> tasks;
+};
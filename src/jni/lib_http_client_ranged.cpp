@@ -0,0 +1,125 @@
+#include "lib_http_client_ranged.h"
+#include "lib_http_client.h"
+#include "lib_http_client_engine.h"
+#include <log.h>
+#include <algorithm>
+#include <cstring>
+
+HttpClientRangedDownload::HttpClientRangedDownload(FakeJni::Jvm &jvm, CURL *templateHandle, std::string url, curl_off_t length, std::shared_ptr<NativeOutputStream> stream, std::function<void(bool, bool)> onDone)
+    : jvm(jvm), templateHandle(templateHandle), url(std::move(url)), stream(std::move(stream)), onDone(std::move(onDone)) {
+    for(curl_off_t start = 0; start < length; start += rangeSize) {
+        ranges.push_back({start, std::min(start + rangeSize, length) - 1});
+    }
+}
+
+HttpClientRangedDownload::~HttpClientRangedDownload() {
+    for(auto &&range : ranges) {
+        if(range.easy) {
+            curl_easy_cleanup(range.easy);
+        }
+    }
+}
+
+void HttpClientRangedDownload::start() {
+    Log::info("HttpClient", "Downloading %s in %zu ranges", url.c_str(), ranges.size());
+    std::lock_guard<std::mutex> lock(mutex);
+    submitRanges();
+}
+
+size_t HttpClientRangedDownload::writeCallback(char *ptr, size_t size, size_t nmemb, void *userdata) {
+    auto range = (Range *)userdata;
+    long responseCode = 0;
+    curl_easy_getinfo(range->easy, CURLINFO_RESPONSE_CODE, &responseCode);
+    // Only a partial content body belongs at this offset, error pages or a full 200 body must not end up in the stream
+    if(responseCode != 206 || range->data.size() + nmemb > (size_t)(range->end - range->start + 1)) {
+        return 0;
+    }
+    range->data.insert(range->data.end(), ptr, ptr + nmemb);
+    return size * nmemb;
+}
+
+void HttpClientRangedDownload::submitRanges() {
+    while(!failed && inFlight < connections && nextToSubmit < ranges.size() && nextToSubmit < nextToDeliver + window) {
+        submit(nextToSubmit++);
+    }
+}
+
+void HttpClientRangedDownload::submit(size_t index) {
+    auto &range = ranges[index];
+    if(!range.easy) {
+        range.easy = curl_easy_duphandle(templateHandle);
+        curl_easy_setopt(range.easy, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(range.easy, CURLOPT_HEADERFUNCTION, nullptr);
+        curl_easy_setopt(range.easy, CURLOPT_HEADERDATA, nullptr);
+        curl_easy_setopt(range.easy, CURLOPT_WRITEFUNCTION, writeCallback);
+        curl_easy_setopt(range.easy, CURLOPT_WRITEDATA, &range);
+        range.data.reserve(range.end - range.start + 1);
+    }
+    // A retry resumes after the bytes this range already received
+    auto rangeHeader = std::to_string(range.start + (curl_off_t)range.data.size()) + "-" + std::to_string(range.end);
+    curl_easy_setopt(range.easy, CURLOPT_RANGE, rangeHeader.c_str());
+    inFlight++;
+    auto me = shared_from_this();
+    HttpClientEngine::getInstance().submit(jvm, range.easy, [me, index](CURLcode ret) {
+        me->onRangeDone(index, ret);
+    });
+}
+
+void HttpClientRangedDownload::onRangeDone(size_t index, CURLcode ret) {
+    std::unique_lock<std::mutex> lock(mutex);
+    inFlight--;
+    auto &range = ranges[index];
+    long responseCode = 0;
+    curl_easy_getinfo(range.easy, CURLINFO_RESPONSE_CODE, &responseCode);
+    bool complete = range.data.size() == (size_t)(range.end - range.start + 1);
+    if(responseCode == 206) {
+        range.committed = range.data.size();
+    } else {
+        range.data.resize(range.committed);
+    }
+    // 200 means the server ignores ranges and a 206 write error means it sent more than asked, retrying does not help either
+    bool unusable = responseCode == 200 || (responseCode == 206 && ret == CURLE_WRITE_ERROR);
+    if(ret == CURLE_OK && responseCode == 206 && complete) {
+        range.done = true;
+    } else if(!unusable && range.retries < maxRetries && !failed) {
+        range.retries++;
+        Log::warn("HttpClient", "Range %lld-%lld failed (%s), resuming at %zu bytes", (long long)range.start, (long long)range.end, curl_easy_strerror(ret), range.data.size());
+        submit(index);
+        return;
+    } else {
+        Log::error("HttpClient", "Range %lld-%lld failed (%s, status %ld)", (long long)range.start, (long long)range.end, curl_easy_strerror(ret), responseCode);
+        failed = true;
+    }
+    if(delivering) {
+        // The thread currently delivering picks up this range
+        return;
+    }
+    delivering = true;
+    while(!failed && nextToDeliver < ranges.size() && ranges[nextToDeliver].done) {
+        auto &ready = ranges[nextToDeliver];
+        lock.unlock();
+        deliverRange(ready);
+        lock.lock();
+        curl_easy_cleanup(ready.easy);
+        ready.easy = nullptr;
+        nextToDeliver++;
+    }
+    delivering = false;
+    submitRanges();
+    if(!finished && inFlight == 0 && (failed || nextToDeliver == ranges.size())) {
+        finished = true;
+        bool ok = !failed;
+        lock.unlock();
+        onDone(ok, ret == CURLE_COULDNT_RESOLVE_HOST || ret == CURLE_COULDNT_CONNECT);
+    }
+}
+
+void HttpClientRangedDownload::deliverRange(Range &range) {
+    size_t length = range.data.size();
+    if(!chunk || chunk->getSize() < length) {
+        chunk = std::make_shared<FakeJni::JByteArray>(length);
+    }
+    memcpy(chunk->getArray(), range.data.data(), length);
+    std::vector<char>().swap(range.data);
+    stream->Write(chunk, length);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <fake-jni/fake-jni.h>
+#include <curl/curl.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class NativeOutputStream;
+
+// Fetches a large body as parallel byte ranges and writes it in order to the game's output stream
+class HttpClientRangedDownload : public std::enable_shared_from_this<HttpClientRangedDownload> {
+public:
+    // Responses at least this large are split into ranges when the server accepts them
+    static constexpr curl_off_t minSize = 64 * 1024 * 1024;
+
+    // template is duplicated for every range, it has to stay alive until onDone was called
+    HttpClientRangedDownload(FakeJni::Jvm &jvm, CURL *templateHandle, std::string url, curl_off_t length, std::shared_ptr<NativeOutputStream> stream, std::function<void(bool ok, bool networkError)> onDone);
+    ~HttpClientRangedDownload();
+
+    void start();
+
+private:
+    struct Range {
+        curl_off_t start;
+        curl_off_t end;
+        CURL *easy = nullptr;
+        std::vector<char> data;
+        // Bytes of data that came from finished attempts with a 206 response
+        size_t committed = 0;
+        int retries = 0;
+        bool done = false;
+    };
+
+    static constexpr curl_off_t rangeSize = 8 * 1024 * 1024;
+    static constexpr size_t connections = 4;
+    // Ranges fetched ahead of the one the game is waiting for, bounds the buffered memory
+    static constexpr size_t window = connections * 2;
+    static constexpr int maxRetries = 3;
+
+    static size_t writeCallback(char *ptr, size_t size, size_t nmemb, void *userdata);
+
+    void submitRanges();
+    void submit(size_t index);
+    void onRangeDone(size_t index, CURLcode ret);
+    void deliverRange(Range &range);
+
+    FakeJni::Jvm &jvm;
+    CURL *templateHandle;
+    std::string url;
+    std::shared_ptr<NativeOutputStream> stream;
+    std::shared_ptr<FakeJni::JByteArray> chunk;
+    std::function<void(bool, bool)> onDone;
+
+    std::mutex mutex;
+    std::vector<Range> ranges;
+    size_t nextToSubmit = 0;
+    size_t nextToDeliver = 0;
+    size_t inFlight = 0;
+    bool delivering = false;
+    bool failed = false;
+    bool finished = false;
+};
@@ -0,0 +1,214 @@
+#include "lib_http_client_recorder.h"
+#include "lib_http_client.h"
+#include "lib_http_client_engine.h"
+#include <FileUtil.h>
+#include <log.h>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <dirent.h>
+
+HttpClientRecorder::Mode HttpClientRecorder::mode = HttpClientRecorder::Mode::Off;
+bool HttpClientRecorder::replayLatency = false;
+std::string HttpClientRecorder::directory;
+std::mutex HttpClientRecorder::mutex;
+std::map<std::string, std::vector<std::string>> HttpClientRecorder::recordings;
+std::map<std::string, size_t> HttpClientRecorder::replayPosition;
+uint64_t HttpClientRecorder::sequence = 0;
+int HttpClientRecorder::writing = 0;
+bool HttpClientRecorder::flushed = false;
+std::condition_variable HttpClientRecorder::writeDone;
+
+static bool writeFile(const std::string &path, const std::vector<char> &data) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+    return (bool)file;
+}
+
+static bool readFile(const std::string &path, std::vector<char> &data) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if(!file) {
+        return false;
+    }
+    data.resize(file.tellg());
+    file.seekg(0);
+    return (bool)file.read(data.data(), data.size());
+}
+
+// Sign in exchanges carry refresh, user and xsts tokens in their bodies
+static bool isCredentialExchange(const std::string &url) {
+    static const char *const hosts[] = {"login.live.com", "login.microsoftonline.com", "auth.xboxlive.com", "sisu.xboxlive.com", "authorization.franchise.minecraft-services.net"};
+    auto begin = url.find("://");
+    begin = begin == std::string::npos ? 0 : begin + 3;
+    auto end = url.find_first_of(":/?#", begin);
+    auto host = url.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+    for(auto suffix : hosts) {
+        size_t length = strlen(suffix);
+        if(host.size() >= length && host.compare(host.size() - length, length, suffix) == 0 && (host.size() == length || host[host.size() - length - 1] == '.')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static nlohmann::json headersToJson(const std::vector<ResponseHeader> &headers) {
+    auto json = nlohmann::json::array();
+    for(auto &&h : headers) {
+        // Recordings end up in bug reports, keep credentials out of them
+        bool secret = strcasecmp(h.name.c_str(), "Authorization") == 0 || strcasecmp(h.name.c_str(), "Cookie") == 0 || strcasecmp(h.name.c_str(), "Set-Cookie") == 0;
+        json.push_back({h.name, secret ? "<redacted>" : h.value});
+    }
+    return json;
+}
+
+static std::vector<ResponseHeader> headersFromJson(const nlohmann::json &json) {
+    std::vector<ResponseHeader> headers;
+    for(auto &&h : json) {
+        headers.emplace_back(h.at(0).get<std::string>(), h.at(1).get<std::string>());
+    }
+    return headers;
+}
+
+std::string HttpClientRecorder::makeKey(const std::string &method, const std::string &url) {
+    return (method.empty() ? "GET" : method) + " " + url;
+}
+
+void HttpClientRecorder::init(Mode mode, std::string directory, bool replayLatency) {
+    if(!directory.empty() && directory.back() != '/') {
+        directory += '/';
+    }
+    HttpClientRecorder::mode = mode;
+    HttpClientRecorder::directory = directory;
+    HttpClientRecorder::replayLatency = replayLatency;
+    FileUtil::mkdirRecursive(directory);
+
+    std::vector<std::string> names;
+    if(auto dir = opendir(directory.c_str())) {
+        while(auto entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if(name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0) {
+                names.push_back(name.substr(0, name.size() - 5));
+            }
+        }
+        closedir(dir);
+    }
+    // Names are zero padded sequence numbers, sorting restores the recording order
+    std::sort(names.begin(), names.end());
+    for(auto &&name : names) {
+        sequence = std::max<uint64_t>(sequence, std::strtoull(name.c_str(), nullptr, 10) + 1);
+        if(mode != Mode::Replay) {
+            continue;
+        }
+        std::ifstream file(directory + name + ".json");
+        auto json = nlohmann::json::parse(file, nullptr, false);
+        if(json.is_discarded()) {
+            Log::warn("HttpClientRecorder", "Skipping unreadable recording %s", name.c_str());
+            continue;
+        }
+        recordings[makeKey(json.value("method", ""), json.value("url", ""))].push_back(name);
+    }
+    if(mode == Mode::Replay) {
+        Log::info("HttpClientRecorder", "Replaying %zu recorded requests from %s", names.size(), directory.c_str());
+    } else {
+        Log::info("HttpClientRecorder", "Recording requests to %s", directory.c_str());
+    }
+}
+
+void HttpClientRecorder::record(const HttpExchange &exchange) {
+    std::string name;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(flushed) {
+            return;
+        }
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%08llu", (unsigned long long)sequence++);
+        name = buffer;
+        writing++;
+    }
+    struct WriteGuard {
+        ~WriteGuard() {
+            std::lock_guard<std::mutex> lock(mutex);
+            writing--;
+            writeDone.notify_all();
+        }
+    } guard;
+    nlohmann::json json;
+    json["method"] = exchange.method.empty() ? "GET" : exchange.method;
+    json["url"] = exchange.url;
+    json["request_headers"] = headersToJson(exchange.requestHeaders);
+    json["status"] = exchange.status;
+    json["response_headers"] = headersToJson(exchange.responseHeaders);
+    json["duration_ms"] = exchange.durationMs;
+    json["truncated"] = exchange.truncated;
+    bool redacted = isCredentialExchange(exchange.url);
+    json["body_redacted"] = redacted;
+    static const std::vector<char> empty;
+    if(!writeFile(directory + name + ".request", redacted ? empty : exchange.requestBody) || !writeFile(directory + name + ".response", redacted ? empty : exchange.responseBody)) {
+        Log::error("HttpClientRecorder", "Failed to record %s", exchange.url.c_str());
+        return;
+    }
+    // The json is written last, replay ignores exchanges without one
+    std::ofstream(directory + name + ".json") << json.dump(4);
+}
+
+bool HttpClientRecorder::replay(const std::string &method, const std::string &url, HttpExchange &exchange) {
+    std::string name;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = recordings.find(makeKey(method, url));
+        if(it == recordings.end()) {
+            return false;
+        }
+        auto &position = replayPosition[it->first];
+        name = it->second[std::min(position, it->second.size() - 1)];
+        position++;
+    }
+    std::ifstream file(directory + name + ".json");
+    auto json = nlohmann::json::parse(file, nullptr, false);
+    if(json.is_discarded()) {
+        return false;
+    }
+    // Serving these would hand the game an empty or cut off body as a successful response
+    if(json.value("truncated", false) || json.value("body_redacted", false)) {
+        Log::warn("HttpClientRecorder", "Failing %s, its body was %s when recording", url.c_str(), json.value("truncated", false) ? "too large" : "redacted");
+        return false;
+    }
+    if(!readFile(directory + name + ".response", exchange.responseBody)) {
+        return false;
+    }
+    readFile(directory + name + ".request", exchange.requestBody);
+    exchange.method = json.value("method", "");
+    exchange.url = json.value("url", "");
+    exchange.requestHeaders = headersFromJson(json.value("request_headers", nlohmann::json::array()));
+    exchange.status = json.value("status", 0L);
+    exchange.responseHeaders = headersFromJson(json.value("response_headers", nlohmann::json::array()));
+    exchange.durationMs = json.value("duration_ms", (int64_t)0);
+    return true;
+}
+
+void HttpClientRecorder::flush() {
+    if(mode != Mode::Record) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    flushed = true;
+    if(!writeDone.wait_for(lock, std::chrono::seconds(5), [] { return writing == 0; })) {
+        Log::warn("HttpClientRecorder", "%d exchanges were still being written on exit", writing);
+    }
+}
+
+void HttpClientRecorder::schedule(const HttpExchange &exchange, std::function<void()> task) {
+    if(!replayLatency || exchange.durationMs <= 0) {
+        HttpClientEngine::getInstance().post(std::move(task));
+        return;
+    }
+    // Sleeping on a worker would delay unrelated requests
+    std::thread([delay = exchange.durationMs, task = std::move(task)]() mutable {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        HttpClientEngine::getInstance().post(std::move(task));
+    }).detach();
+}
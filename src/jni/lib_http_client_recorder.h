@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ResponseHeader;
+
+struct HttpExchange {
+    std::string method;
+    std::string url;
+    std::vector<ResponseHeader> requestHeaders;
+    std::vector<char> requestBody;
+    long status = 0;
+    std::vector<ResponseHeader> responseHeaders;
+    std::vector<char> responseBody;
+    int64_t durationMs = 0;
+    // The body grew beyond maxBodySize and was not kept
+    bool truncated = false;
+};
+
+// Captures lib_http_client exchanges to a directory or serves them back without network access
+struct HttpClientRecorder {
+    enum class Mode {
+        Off,
+        Record,
+        Replay
+    };
+
+    static Mode mode;
+    // Replay waits the recorded duration of each exchange instead of answering immediately
+    static bool replayLatency;
+
+    // Responses larger than this are recorded without their body
+    static constexpr size_t maxBodySize = 128 * 1024 * 1024;
+
+    static void init(Mode mode, std::string directory, bool replayLatency);
+    static void record(const HttpExchange &exchange);
+    // Takes the next recorded exchange for method and url, the last one is repeated once all were served
+    static bool replay(const std::string &method, const std::string &url, HttpExchange &exchange);
+    // Runs task after the exchange's recorded latency, or immediately if replayLatency is off
+    static void schedule(const HttpExchange &exchange, std::function<void()> task);
+    // Stops recording and waits for exchanges that are still being written, called before the process exits
+    static void flush();
+
+private:
+    static std::string directory;
+    static std::mutex mutex;
+    // Recorded file names per request, in recording order
+    static std::map<std::string, std::vector<std::string>> recordings;
+    static std::map<std::string, size_t> replayPosition;
+    static uint64_t sequence;
+    static int writing;
+    static bool flushed;
+    static std::condition_variable writeDone;
+
+    static std::string makeKey(const std::string &method, const std::string &url);
+};
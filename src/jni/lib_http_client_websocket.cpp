@@ -1,9 +1,18 @@
 #include "lib_http_client_websocket.h"
 #include "../util.h"
+#include "jni_methods.h"
 #include <log.h>
 #include <curl/curl.h>
+#include <algorithm>
+#include <cerrno>
+#include <memory>
 #include <thread>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 #if defined(CURLWS_TEXT) && defined(CURLWS_BINARY)
 #define ENABLE_WEBSOCKETS
@@ -14,8 +23,16 @@ HttpClientWebSocket::HttpClientWebSocket(FakeJni::JLong owner) {
 
 #ifdef ENABLE_WEBSOCKETS
     curl = curl_easy_init();
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writecb);
+    // Only do the upgrade in curl_easy_perform, frames are exchanged with curl_ws_recv / curl_ws_send afterwards
+    curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 2L);
+#ifdef __linux__
+    wakeFd[0] = wakeFd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+    if(pipe(wakeFd) == 0) {
+        fcntl(wakeFd[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakeFd[1], F_SETFL, O_NONBLOCK);
+    }
+#endif
 #endif
 
     jvm = (void*)&FakeJni::JniEnvContext().getJniEnv().getVM();
@@ -24,6 +41,17 @@ HttpClientWebSocket::~HttpClientWebSocket() {
 #ifdef ENABLE_WEBSOCKETS
     curl_slist_free_all(header);
     curl_easy_cleanup(curl);
+    for(auto message = sendQueue.exchange(nullptr); message;) {
+        auto next = message->next;
+        delete message;
+        message = next;
+    }
+    if(wakeFd[0] != -1) {
+        close(wakeFd[0]);
+    }
+    if(wakeFd[1] != wakeFd[0] && wakeFd[1] != -1) {
+        close(wakeFd[1]);
+    }
 #endif
 }
 
@@ -31,27 +59,22 @@ void HttpClientWebSocket::connect(std::shared_ptr<FakeJni::JString> url, std::sh
 #ifndef NDEBUG
     Log::trace("HttpClientWebSocket", "connect called, url: %s, wst: %s", url->asStdString().c_str(), wst->asStdString().c_str());
 #endif
+    auto self = std::static_pointer_cast<HttpClientWebSocket>(shared_from_this());
     std::thread([=]() {
 #ifdef ENABLE_WEBSOCKETS
         curl_easy_setopt(curl, CURLOPT_URL, url->asStdString().c_str());
         header = curl_slist_append(header, ("Sec-WebSocket-Protocol: " + wst->asStdString()).data());
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header);
         auto ret = curl_easy_perform(curl);
-        if(ret == CURLE_OK) {
-#ifndef NDEBUG
-            Log::trace("HTTPClientWebSocket", "websocket connection closed");
-#endif
-            sendClosed();
+        if(ret == CURLE_OK && wakeFd[0] != -1) {
+            self->run();
         } else {
-            Log::error("HTTPClientWebSocket", "websocket connection closed with an error");
-            connected = false;
-            FakeJni::LocalFrame frame(*(FakeJni::Jvm*)jvm);
-            auto method = getClass().getMethod("()V", "onFailure");
-            method->invoke(frame.getJniEnv(), this);
+            Log::error("HTTPClientWebSocket", "websocket connection failed: %s", curl_easy_strerror(ret));
+            self->sendFailure();
         }
 #else
         Log::error("HTTPClientWebSocket", "Missing curl websocket support");
-        sendOpened();
+        self->sendOpened();
 #endif
     }).detach();
 }
@@ -64,17 +87,15 @@ void HttpClientWebSocket::addHeader(std::shared_ptr<FakeJni::JString> name, std:
 }
 
 FakeJni::JBoolean HttpClientWebSocket::sendMessage(std::shared_ptr<FakeJni::JString> msg) {
+    auto data = msg->asStdString();
 #ifndef NDEBUG
-    Log::trace("HttpClientWebSocket", "sendMessage called, message: %s", msg->asStdString().c_str());
+    Log::trace("HttpClientWebSocket", "sendMessage called, message: %s", data.c_str());
 #endif
 #ifdef ENABLE_WEBSOCKETS
-    if(!connected) {
-        return false;
-    }
-    size_t sent = 0;
-    curl_ws_send(curl, msg->asStdString().c_str(), msg->asStdString().length(), &sent, 0, CURLWS_TEXT);
-#endif
+    return queueMessage(CURLWS_TEXT, std::move(data));
+#else
     return true;
+#endif
 }
 
 FakeJni::JBoolean HttpClientWebSocket::sendBinaryMessage(std::shared_ptr<jnivm::ByteBuffer> msg) {
@@ -82,13 +103,10 @@ FakeJni::JBoolean HttpClientWebSocket::sendBinaryMessage(std::shared_ptr<jnivm::
     Log::trace("HttpClientWebSocket", "sendBinaryMessage called");
 #endif
 #ifdef ENABLE_WEBSOCKETS
-    if(!connected) {
-        return false;
-    }
-    size_t sent = 0;
-    curl_ws_send(curl, msg->buffer, msg->capacity, &sent, 0, CURLWS_BINARY);
-#endif
+    return queueMessage(CURLWS_BINARY, std::string((const char*)msg->buffer, msg->capacity));
+#else
     return true;
+#endif
 }
 
 void HttpClientWebSocket::disconnect(int id) {
@@ -96,51 +114,224 @@ void HttpClientWebSocket::disconnect(int id) {
     Log::trace("HttpClientWebSocket", "disconnect called, id: %d", id);
 #endif
 #ifdef ENABLE_WEBSOCKETS
+    queueMessage(CURLWS_CLOSE, "");
     connected = false;
-    size_t sent;
-    curl_ws_send(curl, "", 0, &sent, 0, CURLWS_CLOSE);
 #endif
 }
 
-size_t HttpClientWebSocket::write_callback(char *ptr, size_t size, size_t nmemb) {
+bool HttpClientWebSocket::queueMessage(unsigned int flags, std::string data) {
 #ifdef ENABLE_WEBSOCKETS
     if(!connected) {
-        sendOpened();
+        return false;
     }
-    auto frame = curl_ws_meta(curl);
-    if(frame->flags & CURLWS_TEXT) {
-        std::string cont((const char*)ptr, nmemb);
-#ifndef NDEBUG
-        Log::trace("HttpClientWebSocket", "Got message: %s", cont.c_str());
+    auto message = new OutgoingMessage{nullptr, flags, std::chrono::steady_clock::now(), std::move(data)};
+    // Lock free push, the connection thread takes the whole list at once and restores the order
+    message->next = sendQueue.load(std::memory_order_relaxed);
+    while(!sendQueue.compare_exchange_weak(message->next, message, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    uint64_t one = 1;
+    if(write(wakeFd[1], &one, wakeFd[1] == wakeFd[0] ? sizeof(one) : 1) < 0 && errno != EAGAIN) {
+        Log::error("HttpClientWebSocket", "Failed to wake up the connection thread");
+    }
+#endif
+    return true;
+}
+
+#ifdef ENABLE_WEBSOCKETS
+static bool waitForSocket(curl_socket_t socket, short events, int timeout) {
+    pollfd pfd{socket, events, 0};
+    return poll(&pfd, 1, timeout) > 0 && !(pfd.revents & (POLLERR | POLLNVAL));
+}
 #endif
-        FakeJni::LocalFrame frame(*(FakeJni::Jvm*)jvm);
-        auto method = getClass().getMethod("(Ljava/lang/String;)V", "onMessage");
-        method->invoke(frame.getJniEnv(), this, frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>(cont)));
-    } else if(frame->flags & CURLWS_BINARY) {
+
+void HttpClientWebSocket::run() {
+#ifdef ENABLE_WEBSOCKETS
+    curl_socket_t socket = CURL_SOCKET_BAD;
+    curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &socket);
+    if(socket == CURL_SOCKET_BAD) {
+        sendFailure();
+        return;
+    }
+    auto opened = std::chrono::steady_clock::now();
+    sendOpened();
+
+    std::vector<char> buffer(64 * 1024);
+    std::string message;
+    bool messageBinary = false;
+    bool closeSent = false;
+    std::chrono::steady_clock::time_point closeDeadline;
+    bool failed = false;
+    // Frames sent right after the handshake may already sit in curl's buffer and never make the socket readable again
+    bool receivePending = true;
+    while(true) {
+        if(!receivePending) {
+            pollfd fds[2] = {{socket, POLLIN, 0}, {wakeFd[0], POLLIN, 0}};
+            int timeout = closeSent ? (int)std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(closeDeadline - std::chrono::steady_clock::now()).count()) : -1;
+            if(poll(fds, 2, timeout) == 0) {
+                // The server did not answer our close frame in time
+                break;
+            }
+            if(fds[1].revents & POLLIN) {
+                char drain[64];
+                while(read(wakeFd[0], drain, sizeof(drain)) > 0) {
+                }
+                bool wasClosing = closeSent;
+                if(!flushSendQueue(socket, closeSent)) {
+                    failed = true;
+                    break;
+                }
+                if(closeSent && !wasClosing) {
+                    closeDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+                }
+            }
+            if(!(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+        }
+        receivePending = false;
+        bool closed = false;
+        while(true) {
+            size_t received = 0;
+            const struct curl_ws_frame *meta = nullptr;
+            auto ret = curl_ws_recv(curl, buffer.data(), buffer.size(), &received, &meta);
+            if(ret == CURLE_AGAIN) {
+                break;
+            }
+            if(ret == CURLE_GOT_NOTHING) {
+                closed = true;
+                break;
+            }
+            if(ret != CURLE_OK) {
+                Log::error("HttpClientWebSocket", "Receiving failed: %s", curl_easy_strerror(ret));
+                failed = true;
+                break;
+            }
+            if(meta->flags & CURLWS_CLOSE) {
+                closed = true;
+                break;
+            }
+            if(!(meta->flags & (CURLWS_TEXT | CURLWS_BINARY))) {
+                // Pings are answered by curl itself
+                continue;
+            }
+            if(message.empty() && meta->offset == 0) {
+                messageBinary = meta->flags & CURLWS_BINARY;
+            }
+            message.append(buffer.data(), received);
+            // A message is complete once its last frame was read entirely
+            if(meta->bytesleft == 0 && !(meta->flags & CURLWS_CONT)) {
+                deliverMessage(message, messageBinary);
+                message.clear();
+            }
+        }
+        if(closed || failed) {
+            break;
+        }
+    }
+    logStats(opened);
+    if(failed) {
+        sendFailure();
+    } else {
 #ifndef NDEBUG
-        Log::trace("HttpClientWebSocket", "Got binary message");
+        Log::trace("HTTPClientWebSocket", "websocket connection closed");
 #endif
-        FakeJni::LocalFrame frame(*(FakeJni::Jvm*)jvm);
-        auto method = getClass().getMethod("(Ljava/nio/ByteBuffer;)V", "onBinaryMessage");
-        method->invoke(frame.getJniEnv(), this, frame.getJniEnv().createLocalReference(std::make_shared<jnivm::ByteBuffer>(ptr, nmemb)));
+        sendClosed();
     }
 #endif
-    return nmemb;
 }
 
+bool HttpClientWebSocket::flushSendQueue(curl_socket_t socket, bool &closeSent) {
+#ifdef ENABLE_WEBSOCKETS
+    OutgoingMessage *reversed = sendQueue.exchange(nullptr, std::memory_order_acquire);
+    OutgoingMessage *ordered = nullptr;
+    while(reversed) {
+        auto next = reversed->next;
+        reversed->next = ordered;
+        ordered = reversed;
+        reversed = next;
+    }
+    bool ok = true;
+    while(ordered) {
+        std::unique_ptr<OutgoingMessage> message(ordered);
+        ordered = message->next;
+        if(!ok || closeSent) {
+            continue;
+        }
+        ok = sendFrame(socket, message->data, message->flags);
+        if(message->flags & CURLWS_CLOSE) {
+            closeSent = true;
+            continue;
+        }
+        auto latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - message->queued).count();
+        stats.sendLatencyMs = stats.messagesSent ? stats.sendLatencyMs * 0.9 + latency * 0.1 : latency;
+        stats.maxSendLatencyMs = std::max(stats.maxSendLatencyMs, latency);
+        stats.messagesSent++;
+        stats.bytesSent += message->data.size();
+    }
+    return ok;
+#else
+    return false;
+#endif
+}
 
-size_t HttpClientWebSocket::writecb(char *buffer, size_t size, size_t nitems, void *userdata) {
-    return ((HttpClientWebSocket*)userdata)->write_callback(buffer, size, nitems);
+bool HttpClientWebSocket::sendFrame(curl_socket_t socket, const std::string &data, unsigned int flags) {
+#ifdef ENABLE_WEBSOCKETS
+    size_t offset = 0;
+    do {
+        size_t sent = 0;
+        auto ret = curl_ws_send(curl, data.data() + offset, data.size() - offset, &sent, 0, flags);
+        offset += sent;
+        if(ret == CURLE_AGAIN) {
+            if(!waitForSocket(socket, POLLOUT, 5000)) {
+                Log::error("HttpClientWebSocket", "Timed out sending a message");
+                return false;
+            }
+        } else if(ret != CURLE_OK) {
+            Log::error("HttpClientWebSocket", "Sending failed: %s", curl_easy_strerror(ret));
+            return false;
+        }
+    } while(offset < data.size());
+    return true;
+#else
+    return false;
+#endif
+}
+
+void HttpClientWebSocket::deliverMessage(const std::string &data, bool binary) {
+    stats.messagesReceived++;
+    stats.bytesReceived += data.size();
+    FakeJni::LocalFrame frame(*(FakeJni::Jvm*)jvm);
+    if(!binary) {
+#ifndef NDEBUG
+        Log::trace("HttpClientWebSocket", "Got message: %s", data.c_str());
+#endif
+        auto &method = JniMethods::get(JniMethod::WebSocketMessage);
+        method->invoke(frame.getJniEnv(), this, frame.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>(data)));
+    } else {
+#ifndef NDEBUG
+        Log::trace("HttpClientWebSocket", "Got binary message");
+#endif
+        auto &method = JniMethods::get(JniMethod::WebSocketBinaryMessage);
+        method->invoke(frame.getJniEnv(), this, frame.getJniEnv().createLocalReference(std::make_shared<jnivm::ByteBuffer>((char*)data.data(), data.size())));
+    }
+}
+
+void HttpClientWebSocket::logStats(std::chrono::steady_clock::time_point opened) {
+    auto seconds = std::max(std::chrono::duration<double>(std::chrono::steady_clock::now() - opened).count(), 0.001);
+    Log::info("HttpClientWebSocket", "Connection open for %.1fs, sent %llu messages (%.1f KB/s), received %llu messages (%.1f KB/s), send latency avg %.2f ms max %.2f ms",
+              seconds, (unsigned long long)stats.messagesSent, stats.bytesSent / 1024.0 / seconds, (unsigned long long)stats.messagesReceived, stats.bytesReceived / 1024.0 / seconds,
+              stats.sendLatencyMs, stats.maxSendLatencyMs);
 }
 
 void HttpClientWebSocket::sendOpened() {
 #ifndef NDEBUG
     Log::trace("HttpClientWebSocket", "Sending onOpen");
 #endif
+    // Set first so messages sent from onOpen are queued
+    connected = true;
     FakeJni::LocalFrame frame(*(FakeJni::Jvm*)jvm);
-    auto method = getClass().getMethod("()V", "onOpen");
+    auto &method = JniMethods::get(JniMethod::WebSocketOpen);
     method->invoke(frame.getJniEnv(), this);
-    connected = true;
 }
 
 void HttpClientWebSocket::sendClosed() {
@@ -149,6 +340,13 @@ void HttpClientWebSocket::sendClosed() {
 #endif
     connected = false;
     FakeJni::LocalFrame frame(*(FakeJni::Jvm*)jvm);
-    auto method = getClass().getMethod("(I)V", "onClose");
+    auto &method = JniMethods::get(JniMethod::WebSocketClose);
     method->invoke(frame.getJniEnv(), this, 0);
 }
+
+void HttpClientWebSocket::sendFailure() {
+    connected = false;
+    FakeJni::LocalFrame frame(*(FakeJni::Jvm*)jvm);
+    auto &method = JniMethods::get(JniMethod::WebSocketFailure);
+    method->invoke(frame.getJniEnv(), this);
+}
@@ -3,6 +3,8 @@
 #include <log.h>
 #include "lib_http_client.h"
 #include <utility>
+#include <atomic>
+#include <chrono>
 #include <jnivm/bytebuffer.h>
 #include <curl/curl.h>
 
@@ -17,14 +19,40 @@ public:
     FakeJni::JBoolean sendMessage(std::shared_ptr<FakeJni::JString>);
     FakeJni::JBoolean sendBinaryMessage(std::shared_ptr<jnivm::ByteBuffer>);
     void disconnect(int id);
-    
+
 private:
+    // Queued by game threads, only the connection thread touches curl
+    struct OutgoingMessage {
+        OutgoingMessage *next;
+        unsigned int flags;
+        std::chrono::steady_clock::time_point queued;
+        std::string data;
+    };
+    struct Stats {
+        uint64_t messagesSent = 0;
+        uint64_t messagesReceived = 0;
+        uint64_t bytesSent = 0;
+        uint64_t bytesReceived = 0;
+        double sendLatencyMs = 0;
+        double maxSendLatencyMs = 0;
+    };
+
     void *curl;
     void *jvm;
-    bool connected = false;
+    std::atomic<bool> connected = false;
     struct curl_slist *header = nullptr;
-    size_t write_callback(char *ptr, size_t size, size_t nmemb);
-    static size_t writecb(char *buffer, size_t size, size_t nitems, void* data);
+    std::atomic<OutgoingMessage *> sendQueue{nullptr};
+    // eventfd on linux, the read and write end of a pipe elsewhere
+    int wakeFd[2] = {-1, -1};
+    Stats stats;
+
+    bool queueMessage(unsigned int flags, std::string data);
+    void run();
+    bool flushSendQueue(curl_socket_t socket, bool &closeSent);
+    bool sendFrame(curl_socket_t socket, const std::string &data, unsigned int flags);
+    void deliverMessage(const std::string &data, bool binary);
+    void logStats(std::chrono::steady_clock::time_point opened);
     void sendOpened();
     void sendClosed();
+    void sendFailure();
 };
@@ -2,6 +2,9 @@
 #include "../settings.h"
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #ifdef __FreeBSD__
 #include <sys/sysctl.h>
 #include <sys/user.h>
@@ -15,11 +18,23 @@
 #include <file_picker_factory.h>
 #include <game_window_manager.h>
 #include "uuid.h"
+#include "jni_methods.h"
 #include <climits>
+#include <cstring>
 #include <sstream>
 #include <fstream>
+#include <list>
+#include <mutex>
+#include <vector>
+#if defined(__i386__) || defined(__x86_64__)
+#include <tmmintrin.h>
+#include "../cpuid.h"
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #include <android/keycodes.h>
 #include "../core_patches.h"
+#include "../file_transfer.h"
 
 #include <log.h>
 
@@ -165,7 +180,7 @@ void MainActivity::pickImage(FakeJni::JLong callback) {
 }
 
 void MainActivity::initializeXboxLive(FakeJni::JLong xalinit, FakeJni::JLong xblinit) {
-    auto method = getClass().getMethod("(JJ)V", "nativeInitializeXboxLive");
+    auto &method = JniMethods::get(JniMethod::MainActivityInitializeXboxLive);
     FakeJni::LocalFrame frame;
     method->invoke(frame.getJniEnv(), this, xalinit, xblinit);
 }
@@ -215,11 +230,22 @@ void MainActivity::shareFile(std::shared_ptr<FakeJni::JString> title, std::share
     std::string pathStr = path->asStdString();
     picker->setFileName(pathStr.substr(pathStr.find_last_of("/\\") + 1));
     if(picker->show()) {
-        std::ifstream src(pathStr, std::ios::binary);
-        std::ofstream dst(picker->getPickedFile(), std::ios::binary);
-        dst << src.rdbuf();
-        src.close();
-        dst.close();
+        // Pin the export with a link first so the game can delete it while it is still being copied
+        std::string staged = pathStr + ".share";
+        unlink(staged.c_str());
+        auto reportFailure = [](const std::string &dst) {
+            GameWindowManager::getManager()->getErrorHandler()->onError("Export failed", "Failed to save the exported file to " + dst + ", see the log for details");
+        };
+        if(link(pathStr.c_str(), staged.c_str()) == 0) {
+            FileTransfer::copyAsync(staged, picker->getPickedFile(), false, [staged, dst = picker->getPickedFile(), reportFailure](bool ok) {
+                unlink(staged.c_str());
+                if(!ok) {
+                    reportFailure(dst);
+                }
+            });
+        } else if(!FileTransfer::copy(pathStr, picker->getPickedFile(), false)) {
+            reportFailure(picker->getPickedFile());
+        }
     }
 }
 
@@ -237,7 +263,7 @@ void MainActivity::setCaretPosition(FakeJni::JInt pos) {
 }
 
 FakeJni::JLong MainActivity::initializeXboxLive2(FakeJni::JLong xalinit, FakeJni::JLong xblinit) {
-    auto method = getClass().getMethod("(JJ)V", "nativeInitializeXboxLive");
+    auto &method = JniMethods::get(JniMethod::MainActivityInitializeXboxLive);
     FakeJni::LocalFrame frame;
     auto ret = method->invoke(frame.getJniEnv(), this, xalinit, xblinit);
     return ret.j;
@@ -253,27 +279,140 @@ FakeJni::JLong MainActivity::initializeLibHttpClient(FakeJni::JLong init) {
     return ret.j;
 }
 
+// stbi returns RGBA bytes, the game expects ARGB ints which are BGRA bytes in little endian memory
+static void swizzleRgbaScalar(const unsigned char *src, FakeJni::JInt *dst, size_t pixels) {
+    for(size_t x = 0; x < pixels; x++) {
+        dst[x] = (src[x * 4 + 2]) | (src[x * 4 + 1] << 8) | (src[x * 4 + 0] << 16) | (src[x * 4 + 3] << 24);
+    }
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+__attribute__((target("ssse3"))) static void swizzleRgbaSsse3(const unsigned char *src, FakeJni::JInt *dst, size_t pixels) {
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t x = 0;
+    for(; x + 4 <= pixels; x += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x * 4));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_shuffle_epi8(v, mask));
+    }
+    swizzleRgbaScalar(src + x * 4, dst + x, pixels - x);
+}
+#elif defined(__ARM_NEON)
+static void swizzleRgbaNeon(const unsigned char *src, FakeJni::JInt *dst, size_t pixels) {
+    size_t x = 0;
+    for(; x + 16 <= pixels; x += 16) {
+        uint8x16x4_t v = vld4q_u8(src + x * 4);
+        std::swap(v.val[0], v.val[2]);
+        vst4q_u8((uint8_t *)(dst + x), v);
+    }
+    swizzleRgbaScalar(src + x * 4, dst + x, pixels - x);
+}
+#endif
+
+static void (*getSwizzleRgba())(const unsigned char *, FakeJni::JInt *, size_t) {
+#if defined(__i386__) || defined(__x86_64__)
+    if(CpuId().queryFeatureFlag(CpuId::FeatureFlag::SSSE3)) {
+        return swizzleRgbaSsse3;
+    }
+#elif defined(__ARM_NEON)
+    return swizzleRgbaNeon;
+#endif
+    return swizzleRgbaScalar;
+}
+
+// The game asks for the same skins and world icons again every time a list is shown
+namespace {
+struct CachedImage {
+    std::string path;
+    timespec mtime;
+    off_t size;
+    std::vector<FakeJni::JInt> data;
+};
+}  // namespace
+static std::mutex imageCacheLock;
+static std::list<CachedImage> imageCache;
+static size_t imageCacheBytes = 0;
+static const size_t maxImageCacheEntries = 32;
+static const size_t maxImageCacheBytes = 32 * 1024 * 1024;
+
+// Including nanoseconds, seconds alone miss a rewrite within the same second, e.g. a skin saved twice in a row
+static timespec modificationTime(const struct stat &st) {
+#ifdef __APPLE__
+    return st.st_mtimespec;
+#else
+    return st.st_mtim;
+#endif
+}
+
+static std::shared_ptr<FakeJni::JIntArray> toIntArray(const std::vector<FakeJni::JInt> &data) {
+    auto ret = std::make_shared<FakeJni::JIntArray>(data.size());
+    memcpy(ret->getArray(), data.data(), data.size() * sizeof(FakeJni::JInt));
+    return ret;
+}
+
 std::shared_ptr<FakeJni::JIntArray> MainActivity::getImageData(std::shared_ptr<FakeJni::JString> filename) {
     if(!stbi_load_from_memory || !stbi_image_free)
         return 0;
-    int width, height, channels;
-    std::ifstream f(filename->asStdString().data());
-    if(!f.is_open())
+    auto path = filename->asStdString();
+    int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+    if(fd == -1)
         return 0;
-    std::stringstream s;
-    s << f.rdbuf();
-    auto buf = s.str();
-    auto image = stbi_load_from_memory((unsigned char*)buf.data(), buf.length(), &width, &height, &channels, 4);
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size > INT_MAX) {
+        close(fd);
+        return 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(imageCacheLock);
+        for(auto it = imageCache.begin(); it != imageCache.end(); it++) {
+            if(it->path == path) {
+                auto mtime = modificationTime(st);
+                if(it->mtime.tv_sec == mtime.tv_sec && it->mtime.tv_nsec == mtime.tv_nsec && it->size == st.st_size) {
+                    close(fd);
+                    imageCache.splice(imageCache.begin(), imageCache, it);
+                    return toIntArray(it->data);
+                }
+                imageCacheBytes -= it->data.size() * sizeof(FakeJni::JInt);
+                imageCache.erase(it);
+                break;
+            }
+        }
+    }
+    auto file = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file == MAP_FAILED)
+        return 0;
+    int width, height, channels;
+    auto image = stbi_load_from_memory((unsigned char*)file, st.st_size, &width, &height, &channels, 4);
+    munmap(file, st.st_size);
     if(!image)
         return 0;
-    auto ret = std::make_shared<FakeJni::JIntArray>(2 + width * height);
-    (*ret)[0] = width;
-    (*ret)[1] = height;
+    size_t pixels = (size_t)width * height;
+    auto ret = std::make_shared<FakeJni::JIntArray>(2 + pixels);
+    auto data = ret->getArray();
+    data[0] = width;
+    data[1] = height;
+    static auto swizzleRgba = getSwizzleRgba();
+    swizzleRgba(image, data + 2, pixels);
+    stbi_image_free(image);
 
-    for(int x = 0; x < width * height; x++) {
-        (*ret)[2 + x] = (image[x * 4 + 2]) | (image[x * 4 + 1] << 8) | (image[x * 4 + 0] << 16) | (image[x * 4 + 3] << 24);
+    size_t bytes = (2 + pixels) * sizeof(FakeJni::JInt);
+    if(bytes <= maxImageCacheBytes / 4) {
+        std::lock_guard<std::mutex> lock(imageCacheLock);
+        // Another thread may have decoded the same file meanwhile
+        for(auto it = imageCache.begin(); it != imageCache.end(); it++) {
+            if(it->path == path) {
+                imageCacheBytes -= it->data.size() * sizeof(FakeJni::JInt);
+                imageCache.erase(it);
+                break;
+            }
+        }
+        imageCache.push_front({path, modificationTime(st), st.st_size, std::vector<FakeJni::JInt>(data, data + 2 + pixels)});
+        imageCacheBytes += bytes;
+        while(imageCache.size() > maxImageCacheEntries || imageCacheBytes > maxImageCacheBytes) {
+            imageCacheBytes -= imageCache.back().data.size() * sizeof(FakeJni::JInt);
+            imageCache.pop_back();
+        }
     }
-    stbi_image_free(image);
     return ret;
 }
 
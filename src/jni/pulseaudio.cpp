@@ -1,71 +1,271 @@
 #include "pulseaudio.h"
-#include <pulse/simple.h>
 #include <pulse/error.h>
 #include <game_window_manager.h>
+#include <log.h>
+#include <algorithm>
+#include <thread>
+#include "../main.h"
 
 AudioDevice::AudioDevice() {
-    s = nullptr;
+}
+
+AudioDevice::~AudioDevice() {
+    close();
 }
 
 FakeJni::JBoolean AudioDevice::init(FakeJni::JInt channels, FakeJni::JInt samplerate, FakeJni::JInt c, FakeJni::JInt d) {
-    if(s != NULL) {
+    if(mainloop != NULL) {
         GameWindowManager::getManager()->getErrorHandler()->onError("Pulseaudio failed", "pulseaudio already initialized");
+        close();
     }
-    pa_sample_spec ss;
-    ss.format = PA_SAMPLE_S16NE;
-    ss.channels = channels;
-    ss.rate = samplerate;
-    pa_buffer_attr b;
-    b.fragsize = -1;
-    b.maxlength = c * d * channels * 2;
-    b.minreq = -1;
-    b.prebuf = -1;
-    b.tlength = -1;
-    int error = 0;
-    s = pa_simple_new(NULL,            // Use the default server.
-                      "mcpelauncher",  // Our application's name.
-                      PA_STREAM_PLAYBACK,
-                      NULL,     // Use the default device.
-                      "Music",  // Description of our stream.
-                      &ss,      // Our sample format.
-                      NULL,     // Use default channel map
-                      &b,       // buffering attributes.
-                      &error    // error code.
-    );
-    if(s == NULL) {
-        auto errormsg = pa_strerror(error);
-        GameWindowManager::getManager()->getErrorHandler()->onError("Pulseaudio failed", std::string("pulseaudio pa_simple_new failed, audio will be unavailable: ") + (errormsg ? errormsg : "No message from pulseaudio"));
+    if(options.headless) {
+        return false;
+    }
+    spec.format = PA_SAMPLE_S16NE;
+    spec.channels = channels;
+    spec.rate = samplerate;
+    frameSize = channels * 2;
+    uint32_t fmodBuffer = std::max<int>(c * d, 1) * frameSize;
+    // Without an explicit tlength the server queues about 2 s, ask for FMOD's own buffer size instead
+    attr.fragsize = (uint32_t)-1;
+    attr.maxlength = (uint32_t)-1;
+    attr.minreq = (uint32_t)-1;
+    attr.prebuf = (uint32_t)-1;
+    attr.tlength = fmodBuffer;
+    ring.reset(fmodBuffer);
+    closing = false;
+    failed = false;
+    needsData = false;
+    underruns = 0;
+    latencyUsec = 0;
+    maxLatencyUsec = 0;
+    reconnects = 0;
+
+    mainloop = pa_threaded_mainloop_new();
+    if(mainloop == NULL || pa_threaded_mainloop_start(mainloop) < 0) {
+        GameWindowManager::getManager()->getErrorHandler()->onError("Pulseaudio failed", "pulseaudio pa_threaded_mainloop_start failed, audio will be unavailable");
+        close();
+        return false;
+    }
+    std::string error;
+    if(!connect(error)) {
+        GameWindowManager::getManager()->getErrorHandler()->onError("Pulseaudio failed", "pulseaudio connection failed, audio will be unavailable: " + error);
+        close();
         return false;
     }
     return true;
 }
 
-void AudioDevice::write(std::shared_ptr<FakeJni::JByteArray> data, FakeJni::JInt length) {
-    int error = 0;
-    if(s && pa_simple_write(s, data->getArray(), length, &error)) {
-        pa_simple_free(s);
-        s = nullptr;
-        auto errormsg = pa_strerror(error);
-        GameWindowManager::getManager()->getErrorHandler()->onError("Pulseaudio failed", std::string("pulseaudio pa_simple_write failed, please reopen the Launcher to reconnect: ") + (errormsg ? errormsg : "No message from pulseaudio"));
+bool AudioDevice::connect(std::string& error) {
+    pa_threaded_mainloop_lock(mainloop);
+    auto fail = [&](const char* what) {
+        error = std::string(what) + ": " + pa_strerror(pa_context_errno(context));
+        failed = true;
+        pa_threaded_mainloop_unlock(mainloop);
+        return false;
+    };
+    context = pa_context_new(pa_threaded_mainloop_get_api(mainloop), "mcpelauncher");
+    if(context == NULL) {
+        error = "pa_context_new failed";
+        failed = true;
+        pa_threaded_mainloop_unlock(mainloop);
+        return false;
+    }
+    pa_context_set_state_callback(context, onContextState, this);
+    if(pa_context_connect(context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0) {
+        return fail("pa_context_connect failed");
+    }
+    for(pa_context_state_t state; (state = pa_context_get_state(context)) != PA_CONTEXT_READY;) {
+        if(!PA_CONTEXT_IS_GOOD(state)) {
+            return fail("connecting to the server failed");
+        }
+        pa_threaded_mainloop_wait(mainloop);
     }
+
+    s = pa_stream_new(context, "Music", &spec, NULL);
+    if(s == NULL) {
+        return fail("pa_stream_new failed");
+    }
+    pa_stream_set_state_callback(s, onStreamState, this);
+    pa_stream_set_write_callback(s, onWriteRequest, this);
+    pa_stream_set_underflow_callback(s, onUnderflow, this);
+    auto flags = (pa_stream_flags_t)(PA_STREAM_ADJUST_LATENCY | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_INTERPOLATE_TIMING);
+    if(pa_stream_connect_playback(s, NULL, &attr, flags, NULL, NULL) < 0) {
+        return fail("pa_stream_connect_playback failed");
+    }
+    for(pa_stream_state_t state; (state = pa_stream_get_state(s)) != PA_STREAM_READY;) {
+        if(!PA_STREAM_IS_GOOD(state)) {
+            return fail("creating the playback stream failed");
+        }
+        pa_threaded_mainloop_wait(mainloop);
+    }
+    auto actual = pa_stream_get_buffer_attr(s);
+    Log::info("PulseAudio", "Connected, target latency %.1f ms", actual ? pa_bytes_to_usec(actual->tlength, &spec) / 1000.0 : 0.0);
+    failed = false;
+    refill();
+    pa_threaded_mainloop_unlock(mainloop);
+    return true;
 }
 
-void AudioDevice::write2(std::shared_ptr<FakeJni::JShortArray> data, FakeJni::JInt length) {
-    int error = 0;
-    if(s && pa_simple_write(s, data->getArray(), length * 2, &error)) {
-        pa_simple_free(s);
+void AudioDevice::disconnect() {
+    if(mainloop == NULL) {
+        return;
+    }
+    pa_threaded_mainloop_lock(mainloop);
+    if(s) {
+        pa_stream_set_state_callback(s, NULL, NULL);
+        pa_stream_set_write_callback(s, NULL, NULL);
+        pa_stream_set_underflow_callback(s, NULL, NULL);
+        pa_stream_disconnect(s);
+        pa_stream_unref(s);
         s = nullptr;
-        auto errormsg = pa_strerror(error);
-        GameWindowManager::getManager()->getErrorHandler()->onError("Pulseaudio failed", std::string("pulseaudio pa_simple_write failed, please reopen the Launcher to reconnect: ") + (errormsg ? errormsg : "No message from pulseaudio"));
     }
+    if(context) {
+        pa_context_set_state_callback(context, NULL, NULL);
+        pa_context_disconnect(context);
+        pa_context_unref(context);
+        context = nullptr;
+    }
+    pa_threaded_mainloop_unlock(mainloop);
+}
+
+// Called with the mainloop locked, writes as much of the ring as the server asked for
+void AudioDevice::refill() {
+    if(s == NULL || pa_stream_get_state(s) != PA_STREAM_READY) {
+        return;
+    }
+    size_t writable = pa_stream_writable_size(s);
+    if(writable == (size_t)-1) {
+        return;
+    }
+    while(writable > 0) {
+        size_t available = ring.readable() / frameSize * frameSize;
+        if(available == 0) {
+            break;
+        }
+        void* data;
+        size_t n = std::min(writable, available);
+        if(pa_stream_begin_write(s, &data, &n) < 0) {
+            break;
+        }
+        n = ring.read(data, std::min(n, available) / frameSize * frameSize);
+        if(n == 0) {
+            pa_stream_cancel_write(s);
+            break;
+        }
+        pa_stream_write(s, data, n, NULL, 0, PA_SEEK_RELATIVE);
+        writable -= std::min(writable, n);
+    }
+    // The server does not ask again, the next write from FMOD has to push the rest
+    needsData = writable > 0;
+
+    pa_usec_t latency;
+    int negative = 0;
+    if(pa_stream_get_latency(s, &latency, &negative) == 0 && !negative) {
+        latencyUsec.store(latency, std::memory_order_relaxed);
+        if(latency > maxLatencyUsec.load(std::memory_order_relaxed)) {
+            maxLatencyUsec.store(latency, std::memory_order_relaxed);
+        }
+    }
+    // Orders the ring update before the check, pairs with the fence in queue
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(writerWaiting.load()) {
+        std::lock_guard<std::mutex> lock(writeLock);
+        spaceAvailable.notify_one();
+    }
+}
+
+void AudioDevice::onContextState(pa_context* c, void* userdata) {
+    auto self = (AudioDevice*)userdata;
+    if(!PA_CONTEXT_IS_GOOD(pa_context_get_state(c)) && !self->failed.exchange(true)) {
+        Log::warn("PulseAudio", "Connection to the server lost: %s", pa_strerror(pa_context_errno(c)));
+    }
+    pa_threaded_mainloop_signal(self->mainloop, 0);
+}
+
+void AudioDevice::onStreamState(pa_stream* stream, void* userdata) {
+    auto self = (AudioDevice*)userdata;
+    if(!PA_STREAM_IS_GOOD(pa_stream_get_state(stream)) && !self->failed.exchange(true)) {
+        Log::warn("PulseAudio", "Playback stream failed: %s", pa_strerror(pa_context_errno(pa_stream_get_context(stream))));
+    }
+    pa_threaded_mainloop_signal(self->mainloop, 0);
+}
+
+void AudioDevice::onWriteRequest(pa_stream* stream, size_t nbytes, void* userdata) {
+    ((AudioDevice*)userdata)->refill();
+}
+
+void AudioDevice::onUnderflow(pa_stream* stream, void* userdata) {
+    ((AudioDevice*)userdata)->underruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioDevice::queue(const void* data, size_t length) {
+    if(mainloop == NULL || closing) {
+        return;
+    }
+    if(failed) {
+        // Retry at most once per second, in between the audio is dropped at the rate it would have been played
+        auto now = std::chrono::steady_clock::now();
+        if(now - lastReconnect > std::chrono::seconds(1)) {
+            lastReconnect = now;
+            reconnects++;
+            disconnect();
+            std::string error;
+            if(connect(error)) {
+                Log::info("PulseAudio", "Reconnected to the server");
+            } else {
+                Log::warn("PulseAudio", "Reconnecting failed: %s", error.data());
+            }
+        }
+        if(failed) {
+            std::this_thread::sleep_for(std::chrono::microseconds(pa_bytes_to_usec(length, &spec)));
+            return;
+        }
+    }
+    while(true) {
+        size_t n = ring.write(data, length);
+        data = (const char*)data + n;
+        length -= n;
+        // Checked on every pass, refill may set it after an earlier check and the server does not ask again by itself
+        if(needsData.exchange(false)) {
+            pa_threaded_mainloop_lock(mainloop);
+            refill();
+            pa_threaded_mainloop_unlock(mainloop);
+        }
+        if(length == 0) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(writeLock);
+        writerWaiting = true;
+        // Otherwise the ring check in the predicate can be ordered before the flag and miss the wakeup
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        spaceAvailable.wait_for(lock, std::chrono::milliseconds(100), [this]() { return ring.writable() >= frameSize || needsData || failed || closing; });
+        writerWaiting = false;
+        if(failed || closing) {
+            return;
+        }
+    }
+}
+
+void AudioDevice::write(std::shared_ptr<FakeJni::JByteArray> data, FakeJni::JInt length) {
+    queue(data->getArray(), length);
+}
+
+void AudioDevice::write2(std::shared_ptr<FakeJni::JShortArray> data, FakeJni::JInt length) {
+    queue(data->getArray(), length * 2);
 }
 
 void AudioDevice::close() {
-    int error = 0;
-    if(pa_simple_flush(s, &error)) {
-        auto errormsg = pa_strerror(error);
-        GameWindowManager::getManager()->getErrorHandler()->onError("Pulseaudio failed", std::string("pulseaudio pa_simple_flush failed: ") + (errormsg ? errormsg : "No message from pulseaudio"));
+    {
+        std::lock_guard<std::mutex> lock(writeLock);
+        closing = true;
+        spaceAvailable.notify_all();
+    }
+    if(mainloop) {
+        disconnect();
+        pa_threaded_mainloop_stop(mainloop);
+        pa_threaded_mainloop_free(mainloop);
+        mainloop = nullptr;
+        Log::info("PulseAudio", "Closed: %llu underruns, %d reconnects, latency %.1f ms (max %.1f ms)", (unsigned long long)underruns.load(), reconnects, latencyUsec.load() / 1000.0, maxLatencyUsec.load() / 1000.0);
     }
-    pa_simple_free(s);
-    s = nullptr;
 }
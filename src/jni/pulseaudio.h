@@ -1,15 +1,51 @@
 #pragma once
 
 #include <fake-jni/fake-jni.h>
-#include <pulse/simple.h>
+#include <pulse/pulseaudio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include "audio_ring_buffer.h"
 
 class AudioDevice : public FakeJni::JObject {
-    pa_simple* s;
+    pa_threaded_mainloop* mainloop = nullptr;
+    pa_context* context = nullptr;
+    pa_stream* s = nullptr;
+    pa_sample_spec spec;
+    pa_buffer_attr attr;
+    size_t frameSize = 0;
+
+    // Filled by FMOD's mixer thread, drained into the stream by write requests on the mainloop thread
+    AudioRingBuffer ring;
+    std::mutex writeLock;
+    std::condition_variable spaceAvailable;
+    std::atomic<bool> writerWaiting{false};
+    std::atomic<bool> needsData{false};
+    std::atomic<bool> failed{false};
+    std::atomic<bool> closing{false};
+    std::chrono::steady_clock::time_point lastReconnect;
+
+    std::atomic<uint64_t> underruns{0};
+    std::atomic<uint64_t> latencyUsec{0};
+    std::atomic<uint64_t> maxLatencyUsec{0};
+    int reconnects = 0;
+
+    bool connect(std::string& error);
+    void disconnect();
+    void refill();
+    void queue(const void* data, size_t length);
+
+    static void onContextState(pa_context* c, void* userdata);
+    static void onStreamState(pa_stream* stream, void* userdata);
+    static void onWriteRequest(pa_stream* stream, size_t nbytes, void* userdata);
+    static void onUnderflow(pa_stream* stream, void* userdata);
 
 public:
     DEFINE_CLASS_NAME("org/fmod/AudioDevice")
 
     AudioDevice();
+    ~AudioDevice();
 
     FakeJni::JBoolean init(FakeJni::JInt channels, FakeJni::JInt samplerate, FakeJni::JInt c, FakeJni::JInt d);
 
@@ -1,7 +1,9 @@
 #include "sdl3audio.h"
 #include <game_window_manager.h>
 #include <SDL3/SDL.h>
-#include <thread>
+#include <log.h>
+#include <algorithm>
+#include <cstring>
 AudioDevice::AudioDevice() {
     s = nullptr;
     SDL_Init(SDL_INIT_AUDIO);
@@ -16,41 +18,104 @@ AudioDevice::~AudioDevice() {
 FakeJni::JBoolean AudioDevice::init(FakeJni::JInt channels, FakeJni::JInt samplerate, FakeJni::JInt c, FakeJni::JInt d) {
     if(s != NULL) {
         GameWindowManager::getManager()->getErrorHandler()->onError("sdl3audio failed", "sdl3audio already initialized");
+        close();
     }
     SDL_AudioSpec spec;
     spec.channels = channels;
     spec.format = SDL_AUDIO_S16LE;
     spec.freq = samplerate;
-    maxBufferLen = c * d * channels * 2;
-    s = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, nullptr, nullptr);
+    frameSize = channels * 2;
+    // SDL3 cannot set any max buf size and fmod doesn't feed data at the correct rate without one
+    maxBufferLen = std::max<int>(c * d, 1) * frameSize;
+    ring.reset(maxBufferLen);
+    scratch.reset(new char[maxBufferLen]);
+    closing = false;
+    started = false;
+    underruns = 0;
+    bytesWritten = 0;
+    waited = {};
+    s = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, onAudioRequested, this);
     if(s == NULL) {
         auto errormsg = SDL_GetError();
         GameWindowManager::getManager()->getErrorHandler()->onError("sdl3audio failed", std::string("sdl3audio SDL_OpenAudioDeviceStream failed, audio will be unavailable: ") + (errormsg ? errormsg : "No message from sdl3audio"));
         return false;
     }
+    opened = std::chrono::steady_clock::now();
     SDL_ResumeAudioDevice(SDL_GetAudioStreamDevice(s));
     return true;
 }
 
-void AudioDevice::write(std::shared_ptr<FakeJni::JByteArray> data, FakeJni::JInt length) {
-    SDL_PutAudioStreamData(s, data->getArray(), length);
-    // SDL3 cannot set any max buf size and fmod doesn't feeding data with the correct rate without it
-    // appeared as silence and a queue overflow
-    while(SDL_GetAudioStreamQueued(s) > maxBufferLen) {
-        std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+void SDLCALL AudioDevice::onAudioRequested(void* userdata, SDL_AudioStream* stream, int additional, int total) {
+    auto self = (AudioDevice*)userdata;
+    bool underrun = false;
+    while(additional > 0) {
+        size_t chunk = std::min<size_t>(additional, self->ring.size());
+        // Only whole frames, the writer may have queued part of one so far
+        size_t n = self->ring.read(self->scratch.get(), std::min(chunk, self->ring.readable() / self->frameSize * self->frameSize));
+        if(n < chunk) {
+            memset(self->scratch.get() + n, 0, chunk - n);
+            underrun = true;
+        }
+        SDL_PutAudioStreamData(stream, self->scratch.get(), chunk);
+        additional -= chunk;
+    }
+    if(underrun && self->started.load(std::memory_order_relaxed)) {
+        self->underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Orders the ring update before the check, pairs with the fence in queue
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(self->writerWaiting.load()) {
+        std::lock_guard<std::mutex> lock(self->writeLock);
+        self->spaceAvailable.notify_one();
     }
 }
 
-void AudioDevice::write2(std::shared_ptr<FakeJni::JShortArray> data, FakeJni::JInt length) {
-    SDL_PutAudioStreamData(s, data->getArray(), length * 2);
-    // SDL3 cannot set any max buf size and fmod doesn't feeding data with the correct rate without it
-    // appeared as silence and a queue overflow
-    while(SDL_GetAudioStreamQueued(s) > maxBufferLen) {
-        std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+void AudioDevice::queue(const void* data, size_t length) {
+    if(s == nullptr) {
+        return;
     }
+    started.store(true, std::memory_order_relaxed);
+    bytesWritten += length;
+    while(true) {
+        size_t n = ring.write(data, length);
+        data = (const char*)data + n;
+        length -= n;
+        if(length == 0) {
+            return;
+        }
+        // Block until the callback drained something instead of spinning, the timeout covers a stalled device
+        auto start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(writeLock);
+        writerWaiting = true;
+        // Otherwise the ring check in the predicate can be ordered before the flag and miss the wakeup
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        spaceAvailable.wait_for(lock, std::chrono::milliseconds(100), [this]() { return ring.writable() >= frameSize || closing; });
+        writerWaiting = false;
+        waited += std::chrono::steady_clock::now() - start;
+        if(closing) {
+            return;
+        }
+    }
+}
+
+void AudioDevice::write(std::shared_ptr<FakeJni::JByteArray> data, FakeJni::JInt length) {
+    queue(data->getArray(), length);
+}
+
+void AudioDevice::write2(std::shared_ptr<FakeJni::JShortArray> data, FakeJni::JInt length) {
+    queue(data->getArray(), length * 2);
 }
 
 void AudioDevice::close() {
-    SDL_DestroyAudioStream(s);
-    s = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(writeLock);
+        closing = true;
+        spaceAvailable.notify_all();
+    }
+    if(s) {
+        SDL_DestroyAudioStream(s);
+        s = nullptr;
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - opened).count();
+        Log::info("sdl3audio", "Closed after %.1f s: %llu bytes written, %llu underruns, writer blocked %.1f%% of the time", seconds, (unsigned long long)bytesWritten, (unsigned long long)underruns.load(), seconds > 0 ? std::chrono::duration<double>(waited).count() * 100 / seconds : 0);
+    }
 }
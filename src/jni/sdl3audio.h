@@ -2,10 +2,33 @@
 
 #include <fake-jni/fake-jni.h>
 #include <SDL3/SDL.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include "audio_ring_buffer.h"
 
 class AudioDevice : public FakeJni::JObject {
     SDL_AudioStream* s;
     int maxBufferLen;
+    size_t frameSize;
+
+    // Filled by FMOD's mixer thread, drained by the SDL stream callback
+    AudioRingBuffer ring;
+    std::unique_ptr<char[]> scratch;
+    std::mutex writeLock;
+    std::condition_variable spaceAvailable;
+    std::atomic<bool> writerWaiting{false};
+    std::atomic<bool> closing{false};
+    std::atomic<bool> started{false};
+
+    std::atomic<uint64_t> underruns{0};
+    uint64_t bytesWritten = 0;
+    std::chrono::steady_clock::duration waited{};
+    std::chrono::steady_clock::time_point opened;
+
+    static void SDLCALL onAudioRequested(void* userdata, SDL_AudioStream* stream, int additional, int total);
+    void queue(const void* data, size_t length);
 
 public:
     DEFINE_CLASS_NAME("org/fmod/AudioDevice")
@@ -3,17 +3,41 @@
 #include <log.h>
 #include "xbox_live.h"
 #include "../xbox_live_helper.h"
+#include "jni_methods.h"
 #include <msa/client/error.h>
+#include <algorithm>
 
 std::shared_ptr<FakeJni::JString> XboxInterop::getLocalStoragePath(std::shared_ptr<Context> context) {
     return std::make_shared<FakeJni::JString>(PathHelper::getPrimaryDataDirectory());
 }
 
-std::shared_ptr<FakeJni::JString> XboxInterop::readConfigFile(std::shared_ptr<Context> context) {
+static std::string readConfig() {
     std::string str;
     if(!FileUtil::readFile(PathHelper::findGameFile("assets/xboxservices.config"), str))
         str = "{}";
-    return std::make_shared<FakeJni::JString>(str);
+    return str;
+}
+
+std::shared_ptr<FakeJni::JString> XboxInterop::readConfigFile(std::shared_ptr<Context> context) {
+    return std::make_shared<FakeJni::JString>(readConfig());
+}
+
+std::vector<std::string> XboxInterop::readConfigHosts() {
+    std::vector<std::string> hosts;
+    auto config = readConfig();
+    for(size_t pos = config.find("\\/"); pos != std::string::npos; pos = config.find("\\/", pos)) {
+        config.erase(pos, 1);
+    }
+    // The config format differs between versions, so look for urls instead of known keys
+    for(size_t pos = config.find("https://"); pos != std::string::npos; pos = config.find("https://", pos)) {
+        pos += 8;
+        auto end = config.find_first_of("/:\"'?# \t\r\n", pos);
+        auto host = config.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        if(!host.empty() && std::find(hosts.begin(), hosts.end(), host) == hosts.end()) {
+            hosts.push_back(host);
+        }
+    }
+    return hosts;
 }
 
 std::shared_ptr<FakeJni::JString> XboxInterop::getLocale() {
@@ -73,7 +97,7 @@ void XboxInterop::logCLL(std::shared_ptr<FakeJni::JString> ticket, std::shared_p
 void XboxInterop::ticketCallback(FakeJni::Jvm const &vm, std::string const &ticket, int requestCode, int errorCode,
                                  std::string const &error) {
     FakeJni::LocalFrame env(vm);
-    auto callback = getDescriptor()->getMethod("(Ljava/lang/String;IILjava/lang/String;)V", "ticket_callback");
+    auto &callback = JniMethods::get(JniMethod::XboxTicketCallback);
     auto ticketRef = env.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>(ticket));
     auto errorStrRef = env.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>(error));
     callback->invoke(env.getJniEnv(), getDescriptor().get(), ticketRef, requestCode, errorCode, errorStrRef);
@@ -81,21 +105,21 @@ void XboxInterop::ticketCallback(FakeJni::Jvm const &vm, std::string const &tick
 
 void XboxInterop::authFlowCallback(FakeJni::Jvm const &vm, FakeJni::JLong userPtr, int status, std::string const &cid) {
     FakeJni::LocalFrame env(vm);
-    auto callback = getDescriptor()->getMethod("(JILjava/lang/String;)V", "auth_flow_callback");
+    auto &callback = JniMethods::get(JniMethod::XboxAuthFlowCallback);
     auto cidRef = env.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>(cid));
     callback->invoke(env.getJniEnv(), getDescriptor().get(), userPtr, status, cidRef);
 }
 
 void XboxInterop::signOutCallback() {
     FakeJni::LocalFrame env;
-    auto callback = getDescriptor()->getMethod("()V", "sign_out_callback");
+    auto &callback = JniMethods::get(JniMethod::XboxSignOutCallback);
     callback->invoke(env.getJniEnv(), getDescriptor().get());
 }
 
 void XboxInterop::invokeXBLogin(FakeJni::Jvm const &vm, FakeJni::JLong userPtr, std::string const &ticket,
                                 std::shared_ptr<XboxLoginCallback> callback) {
     FakeJni::LocalFrame env(vm);
-    auto fn = getDescriptor()->getMethod("(JLjava/lang/String;Lcom/microsoft/xbox/idp/interop/Interop$XBLoginCallback;)V", "invoke_xb_login");
+    auto &fn = JniMethods::get(JniMethod::XboxInvokeXbLogin);
     auto ticketRef = env.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>(ticket));
     auto callbackRef = env.getJniEnv().createLocalReference(callback);
     fn->invoke(env.getJniEnv(), getDescriptor().get(), userPtr, ticketRef, callbackRef);
@@ -104,7 +128,7 @@ void XboxInterop::invokeXBLogin(FakeJni::Jvm const &vm, FakeJni::JLong userPtr,
 void XboxInterop::invokeEventInitialization(FakeJni::Jvm const &vm, FakeJni::JLong userPtr, std::string const &ticket,
                                             std::shared_ptr<XboxLoginCallback> callback) {
     FakeJni::LocalFrame env(vm);
-    auto fn = getDescriptor()->getMethod("(JLjava/lang/String;Lcom/microsoft/xbox/idp/interop/Interop$EventInitializationCallback;)V", "invoke_event_initialization");
+    auto &fn = JniMethods::get(JniMethod::XboxInvokeEventInitialization);
     auto ticketRef = env.getJniEnv().createLocalReference(std::make_shared<FakeJni::JString>(ticket));
     auto callbackRef = env.getJniEnv().createLocalReference(callback);
     fn->invoke(env.getJniEnv(), getDescriptor().get(), userPtr, ticketRef, callbackRef);
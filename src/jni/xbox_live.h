@@ -12,6 +12,8 @@ public:
     static std::shared_ptr<FakeJni::JString> getLocalStoragePath(std::shared_ptr<Context> context);
 
     static std::shared_ptr<FakeJni::JString> readConfigFile(std::shared_ptr<Context> context);
+    // Host names of all https urls in xboxservices.config
+    static std::vector<std::string> readConfigHosts();
 
     static std::shared_ptr<FakeJni::JString> getLocale();
 
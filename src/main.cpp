@@ -17,6 +17,13 @@
 #include "strafe_sprint_patch.h"
 #include "jni/jni_support.h"
 #include "jni/store.h"
+#include "jni/lib_http_client_recorder.h"
+#include "jni/lib_http_client_cache.h"
+#include "jni/lib_http_client_engine.h"
+#include "jni/xbox_live.h"
+#include "jni/jni_profiler.h"
+#include "network_reachability.h"
+#include "file_transfer.h"
 #if defined(__i386__) || defined(__x86_64__)
 #include "cpuid.h"
 #include "texel_aa_patch.h"
@@ -41,6 +48,8 @@
 #include <FileUtil.h>
 #include <properties/property.h>
 #include <fstream>
+#include <algorithm>
+#include <chrono>
 #include "glad/glad.h"
 // For getpid
 #include <unistd.h>
@@ -48,6 +57,10 @@
 #include <daemon_utils/auto_shutdown_service.h>
 #include "settings.h"
 #include "imgui_ui.h"
+#include "frame_stats.h"
+#ifdef USE_IMGUI
+#include "frame_capture.h"
+#endif
 
 struct RpcCallbackServer : daemon_utils::auto_shutdown_service {
     RpcCallbackServer(const std::string& path, JniSupport& support) : daemon_utils::auto_shutdown_service(path, daemon_utils::shutdown_policy::never) {
@@ -65,6 +78,21 @@ struct RpcCallbackServer : daemon_utils::auto_shutdown_service {
             }
             cb(simpleipc::rpc_json_result::response({}));
         });
+#ifdef USE_IMGUI
+        add_handler_async("mcpelauncher-client/screenshot", [](simpleipc::connection& conn, std::string const& method, nlohmann::json const& data, result_handler const& cb) {
+            FrameCapture::requestScreenshot();
+            cb(simpleipc::rpc_json_result::response({}));
+        });
+        // data is the capture interval in frames, 0 stops the recording
+        add_handler_async("mcpelauncher-client/record", [](simpleipc::connection& conn, std::string const& method, nlohmann::json const& data, result_handler const& cb) {
+            int interval = data.is_number_integer() ? data.get<int>() : 0;
+            FrameCapture::stopSequence();
+            if(interval > 0) {
+                FrameCapture::startSequence(interval);
+            }
+            cb(simpleipc::rpc_json_result::response({}));
+        });
+#endif
     }
 };
 
@@ -73,20 +101,54 @@ LauncherOptions options;
 
 void printVersionInfo();
 
+#ifdef HAVE_SDL3
+// Must run before GameWindowManager::getManager(), which picks its video and audio backends on first use
+static void selectHeadlessBackends() {
+    // Existing values win so CI can override them
+    setenv("SDL_VIDEO_DRIVER", "offscreen", 0);
+    setenv("SDL_AUDIO_DRIVER", "dummy", 0);
+    setenv("EGL_PLATFORM", "surfaceless", 0);
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+    // Surfaceless EGL only hands out GLES contexts, the desktop GL core patch does not apply
+    options.graphicsApi = GraphicsApi::OPENGL_ES2;
+}
+#endif
+
+// Writes out everything that is only kept in memory or on worker threads, then exits without running the game's destructors
+[[noreturn]] static void exitLauncher() {
+    FileTransfer::waitForPending();
+    JniSupport::removeImportedFiles();
+    HttpClientRecorder::flush();
+    HttpClientCache::logStats();
+#ifdef USE_IMGUI
+    FrameCapture::flush();
+#endif
+    if(JniProfiler::enabled) {
+        if(JniProfiler::dumpJson(JniProfiler::outputPath)) {
+            Log::info("JniProfiler", "Wrote the jni call report to %s", JniProfiler::outputPath.data());
+        } else {
+            Log::error("JniProfiler", "Failed to write the jni call report to %s", JniProfiler::outputPath.data());
+        }
+    }
+    // Workaround for XboxLive ShutdownFreeze
+    _Exit(0);
+}
+
 void loadGameOptions();
 
 template <const char** names, class>
 class SmartStub;
 template <const char** names, size_t... I>
 class SmartStub<names, std::integer_sequence<size_t, I...>> {
-public:
     template <size_t i>
-    static int Add(std::unordered_map<std::string, void*>& android_syms) {
-        android_syms.insert({names[i], (void*)+[]() { Log::warn("Main", "Android stub %s called", names[i]); }});
-        return 0;
+    static void stub() {
+        Log::warn("Main", "Android stub %s called", names[i]);
     }
-    static void AddAll(std::unordered_map<std::string, void*>& android_syms) {
-        int a[] = {Add<I>(android_syms)...};
+
+public:
+    static HookTable getHooks() {
+        static const std::pair<const char*, void*> hooks[] = {{names[I], (void*)&stub<I>}...};
+        return hooks;
     }
 };
 
@@ -136,6 +198,13 @@ int main(int argc, char* argv[]) {
     argparser::arg<bool> freeOnly(p, "--free-only", "-f", "Only allow starting free versions", false);
     argparser::arg<bool> emulateTouch(p, "--emulate-touch", "-et", "Emulate touch with mouse", false);
     argparser::arg<std::string> mods(p, "--mods", "-m", "Additional directories to load mods from split by ','", "");
+    argparser::arg<bool> headless(p, "--headless", "-hl", "Render offscreen without a display, audio and input are stubbed, needs the SDL3 game window backend", false);
+    argparser::arg<int> benchmarkDuration(p, "--benchmark-duration", "-bd", "Quit after the given number of seconds and write the frame times to --benchmark-output", 0);
+    argparser::arg<std::string> benchmarkOutput(p, "--benchmark-output", "-bo", "Json file for the frame times of --benchmark-duration", "");
+    argparser::arg<std::string> httpRecord(p, "--http-record", "-hrec", "Record every http request of the game to the given directory", "");
+    argparser::arg<std::string> httpReplay(p, "--http-replay", "-hrep", "Answer http requests of the game from a --http-record directory without network access", "");
+    argparser::arg<std::string> jniProfile(p, "--jni-profile", "-jp", "Measure calls across the JNI boundary, shown in the ImGui menu and written as json to the given file on exit", "");
+    argparser::arg<bool> httpReplayLatency(p, "--http-replay-latency", "-hrl", "Delay replayed http responses by their recorded duration", false);
 
     if(!p.parse(argc, (const char**)argv))
         return 1;
@@ -150,6 +219,25 @@ int main(int argc, char* argv[]) {
     options.graphicsApi = forceEgl.get() ? GraphicsApi::OPENGL_ES2 : GraphicsApi::OPENGL;
     options.useStdinImport = stdinImpt;
     options.emulateTouch = emulateTouch;
+    options.headless = headless;
+    if(options.headless) {
+#ifdef HAVE_SDL3
+        selectHeadlessBackends();
+#else
+        // Only SDL3's offscreen driver gives FakeEGL a window surface without a display, GLFW ignores SDL_VIDEO_DRIVER
+        Log::error("Launcher", "--headless requires a build with the SDL3 game window backend");
+        return 1;
+#endif
+    }
+    if(!jniProfile.get().empty()) {
+        JniProfiler::enabled = true;
+        JniProfiler::outputPath = jniProfile;
+    }
+    if(!httpReplay.get().empty()) {
+        HttpClientRecorder::init(HttpClientRecorder::Mode::Replay, httpReplay, httpReplayLatency);
+    } else if(!httpRecord.get().empty()) {
+        HttpClientRecorder::init(HttpClientRecorder::Mode::Record, httpRecord, false);
+    }
     std::vector<std::string> modDirs;
     for(size_t i = 0; i < mods.get().length();) {
         auto r = mods.get().find(',', i);
@@ -367,7 +455,7 @@ Hardware	: Qualcomm Technologies, Inc MSM8998
     }
     linker::update_LD_LIBRARY_PATH(PathHelper::findGameFile(std::string("lib/") + MinecraftUtils::getLibraryAbi()).data());
     bool fmodLoaded = false;
-    if(!disableFmod) {
+    if(!disableFmod && !options.headless) {
         try {
             MinecraftUtils::loadFMod();
             fmodLoaded = true;
@@ -398,19 +486,16 @@ Hardware	: Qualcomm Technologies, Inc MSM8998
         linker::load_library("libGLESv2.so", {});
     }
 
-    std::unordered_map<std::string, void*> android_syms;
-    FakeAssetManager::initHybrisHooks(android_syms);
-    FakeInputQueue::initHybrisHooks(android_syms);
-    FakeLooper::initHybrisHooks(android_syms);
-    FakeWindow::initHybrisHooks(android_syms);
-    SmartStub<android_symbols, std::make_index_sequence<(sizeof(android_symbols) / sizeof(*android_symbols)) - 1>>::AddAll(android_syms);
-    linker::load_library("libandroid.so", android_syms);
+    // Generated stubs come first so the real hooks replace them
+    linker::load_library("libandroid.so", HookTable::merge({SmartStub<android_symbols, std::make_index_sequence<(sizeof(android_symbols) / sizeof(*android_symbols)) - 1>>::getHooks(),
+                                                            FakeAssetManager::getHybrisHooks(),
+                                                            FakeInputQueue::getHybrisHooks(),
+                                                            FakeLooper::getHybrisHooks(),
+                                                            FakeWindow::getHybrisHooks()}));
     CorePatches::loadGameWindowLibrary();
 
 #ifdef HAVE_SDL3AUDIO
-    std::unordered_map<std::string, void*> audio_syms;
-    FakeAudio::initHybrisHooks(audio_syms);
-    linker::load_library("libaaudio.so", audio_syms);
+    linker::load_library("libaaudio.so", HookTable::merge({FakeAudio::getHybrisHooks()}));
 #endif
 
     linker::load_library("libmcpelauncher_menu.so", {
@@ -430,6 +515,24 @@ Hardware	: Qualcomm Technologies, Inc MSM8998
     std::vector<mcpelauncher_hook_t> mcpeHooks;
     FakeSwappyGL::initHooks(mcpeHooks);
 
+    if(Settings::enable_connection_prewarm && HttpClientRecorder::mode != HttpClientRecorder::Mode::Replay && NetworkReachability::hasRoute()) {
+        // Runs while the game library loads, the first sign in and store requests reuse these connections
+        auto hosts = XboxInterop::readConfigHosts();
+        auto& extraHosts = Settings::prewarm_hosts;
+        for(size_t i = 0; i < extraHosts.length();) {
+            auto r = extraHosts.find(',', i);
+            auto host = extraHosts.substr(i, r == std::string::npos ? std::string::npos : r - i);
+            if(!host.empty() && std::find(hosts.begin(), hosts.end(), host) == hosts.end()) {
+                hosts.push_back(host);
+            }
+            if(r == std::string::npos) {
+                break;
+            }
+            i = r + 1;
+        }
+        HttpClientEngine::getInstance().prewarm(std::move(hosts));
+    }
+
     Log::trace("Launcher", "Loading Minecraft library");
     static void* handle = MinecraftUtils::loadMinecraftLib(reinterpret_cast<void*>(&CorePatches::showMousePointer), reinterpret_cast<void*>(&CorePatches::hideMousePointer), reinterpret_cast<void*>(&CorePatches::setFullscreen), reinterpret_cast<void*>(&FakeLooper::onGameActivityClose), mcpeHooks);
     if(!handle && options.graphicsApi == GraphicsApi::OPENGL) {
@@ -559,6 +662,35 @@ Hardware	: Qualcomm Technologies, Inc MSM8998
     });
     startThread.detach();
 
+    if(benchmarkDuration.get() > 0) {
+        std::thread([duration = benchmarkDuration.get(), output = benchmarkOutput.get()]() {
+            // Loading the game takes a varying amount of time, only the rendered frames are measured
+            while(FrameStats::getFrameCount() == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            auto next = FrameStats::getFrameCount();
+            Log::info("Benchmark", "First frame rendered, measuring for %d seconds", duration);
+            // The ring only holds the last FrameStats::capacity frames, drain it often enough that none are overwritten
+            std::vector<float> frames;
+            size_t lost = 0;
+            auto end = std::chrono::steady_clock::now() + std::chrono::seconds(duration);
+            while(std::chrono::steady_clock::now() < end) {
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(std::chrono::milliseconds(250), end - std::chrono::steady_clock::now()));
+                lost += FrameStats::collect(next, frames);
+            }
+            if(lost) {
+                Log::warn("Benchmark", "%zu frame times were overwritten before they could be collected", lost);
+            }
+            auto path = output.empty() ? PathHelper::getPrimaryDataDirectory() + "benchmark.json" : output;
+            if(FrameStats::dumpJson(path, Settings::fps_hud_stutter_threshold, frames, lost)) {
+                Log::info("Benchmark", "Wrote frame times to %s", path.data());
+            } else {
+                Log::error("Benchmark", "Failed to write frame times to %s", path.data());
+            }
+            exitLauncher();
+        }).detach();
+    }
+
     std::unique_ptr<RpcCallbackServer> file_handler;
     try {
         FileUtil::mkdirRecursive(defaultDataDir);
@@ -573,9 +705,7 @@ Hardware	: Qualcomm Technologies, Inc MSM8998
 
     //    XboxLivePatches::workaroundShutdownFreeze(handle);
     XboxLiveHelper::getInstance().shutdown();
-    // Workaround for XboxLive ShutdownFreeze
-    _Exit(0);
-    return 0;
+    exitLauncher();
 }
 
 void printVersionInfo() {
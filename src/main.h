@@ -6,6 +6,7 @@ struct LauncherOptions {
     int windowWidth, windowHeight;
     bool useStdinImport;
     bool emulateTouch;
+    bool headless;
     GraphicsApi graphicsApi;
     std::string importFilePath;
     std::string sendUri;
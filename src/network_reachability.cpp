@@ -0,0 +1,156 @@
+#include "network_reachability.h"
+#include <log.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+static std::atomic<bool> online{true};
+
+// Any host the game talks to on startup works, this one answers for every edition
+static const char *probeHost = "client.discovery.minecraft-services.net";
+
+static bool hasRoute(int family, const char *address) {
+    int fd = socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if(fd == -1) {
+        return false;
+    }
+    sockaddr_storage addr{};
+    socklen_t length;
+    if(family == AF_INET) {
+        auto in = (sockaddr_in *)&addr;
+        in->sin_family = AF_INET;
+        in->sin_port = htons(53);
+        inet_pton(AF_INET, address, &in->sin_addr);
+        length = sizeof(sockaddr_in);
+    } else {
+        auto in6 = (sockaddr_in6 *)&addr;
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(53);
+        inet_pton(AF_INET6, address, &in6->sin6_addr);
+        length = sizeof(sockaddr_in6);
+    }
+    // Connecting an udp socket only performs the route lookup
+    bool ok = connect(fd, (sockaddr *)&addr, length) == 0;
+    close(fd);
+    return ok;
+}
+
+bool NetworkReachability::hasRoute() {
+    return ::hasRoute(AF_INET, "1.1.1.1") || ::hasRoute(AF_INET6, "2606:4700:4700::1111");
+}
+
+bool NetworkReachability::hasProxy() {
+    for(auto name : {"https_proxy", "HTTPS_PROXY", "http_proxy", "HTTP_PROXY", "all_proxy", "ALL_PROXY"}) {
+        auto value = getenv(name);
+        if(value && *value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool connectWithTimeout(const addrinfo *ai, int timeoutMs) {
+    int fd = socket(ai->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd == -1) {
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    bool ok = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+    if(!ok && errno == EINPROGRESS) {
+        pollfd pfd{fd, POLLOUT, 0};
+        int error = 0;
+        socklen_t length = sizeof(error);
+        ok = poll(&pfd, 1, timeoutMs) > 0 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+    }
+    close(fd);
+    return ok;
+}
+
+bool NetworkReachability::probe() {
+    // Without any route the connect below fails right away as well, this just skips the dns timeout
+    if(!hasRoute()) {
+        return false;
+    }
+    addrinfo hints{};
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+    if(getaddrinfo(probeHost, "443", &hints, &result) != 0) {
+        return false;
+    }
+    bool ok = false;
+    for(auto ai = result; ai && !ok; ai = ai->ai_next) {
+        ok = connectWithTimeout(ai, 3000);
+    }
+    freeaddrinfo(result);
+    return ok;
+}
+
+bool NetworkReachability::isOnline() {
+    return online.load(std::memory_order_relaxed);
+}
+
+static void update(const std::function<void(bool)> &onChange) {
+    bool now = NetworkReachability::probe();
+    if(online.exchange(now) != now) {
+        Log::info("NetworkReachability", "Network is now %s", now ? "online" : "offline, requests fail immediately until it comes back");
+        onChange(now);
+    }
+}
+
+void NetworkReachability::start(std::function<void(bool online)> onChange) {
+    if(hasProxy()) {
+        Log::info("NetworkReachability", "A proxy is configured, requests are always attempted");
+        return;
+    }
+    std::thread([onChange = std::move(onChange)]() {
+        update(onChange);
+#ifdef __linux__
+        int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        sockaddr_nl addr{};
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR | RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+        if(fd != -1 && bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0) {
+            char buffer[8192];
+            while(true) {
+                // While offline the upstream network may come back without any local change, probe again now and then
+                pollfd event{fd, POLLIN, 0};
+                int ready = poll(&event, 1, online ? -1 : 30000);
+                if(ready < 0 && errno != EINTR) {
+                    break;
+                }
+                if(ready > 0 && recv(fd, buffer, sizeof(buffer), 0) < 0 && errno != EINTR && errno != ENOBUFS) {
+                    break;
+                }
+                // Interfaces usually emit a burst of link, address and route events, probe once it settled
+                pollfd pfd{fd, POLLIN, 0};
+                while(poll(&pfd, 1, 500) > 0) {
+                    recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+                }
+                update(onChange);
+            }
+        }
+        Log::warn("NetworkReachability", "Netlink is unavailable, falling back to polling");
+        if(fd != -1) {
+            close(fd);
+        }
+#endif
+        while(true) {
+            std::this_thread::sleep_for(std::chrono::seconds(online ? 60 : 15));
+            update(onChange);
+        }
+    }).detach();
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <functional>
+
+// Tracks whether the game's services are reachable, so requests can fail fast while offline
+struct NetworkReachability {
+    // Starts out online and probes on a background thread, only a failed probe reports offline
+    static void start(std::function<void(bool online)> onChange);
+    static bool isOnline();
+    // Cheap check for a route to a public address, sends no packets
+    static bool hasRoute();
+    // Resolves and connects to a service host, blocks for up to a few seconds
+    static bool probe();
+    // curl connects through the proxy, whether a direct route exists does not matter then
+    static bool hasProxy();
+};
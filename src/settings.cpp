@@ -15,6 +15,7 @@ bool Settings::enable_menubar = true;
 int Settings::enable_fps_hud;
 float Settings::fps_hud_x;
 float Settings::fps_hud_y;
+float Settings::fps_hud_stutter_threshold;
 
 int Settings::enable_keystroke_hud;
 float Settings::keystroke_hud_x;
@@ -26,6 +27,10 @@ std::string Settings::menubarFocusKey;
 bool Settings::fullscreen;
 bool Settings::vsync;
 
+bool Settings::enable_lazy_jni_classes;
+bool Settings::enable_connection_prewarm;
+std::string Settings::prewarm_hosts;
+
 char GameOptions::leftKey = 'A';
 char GameOptions::downKey = 'S';
 char GameOptions::rightKey = 'D';
@@ -48,6 +53,7 @@ static properties::property<bool> enable_menubar(settings, "enable_menubar", /*
 static properties::property<int> enable_fps_hud(settings, "enable_fps_hud", /* default if not defined*/ false);
 static properties::property<float> fps_hud_x(settings, "fps_hud_x", /* default if not defined*/ 0);
 static properties::property<float> fps_hud_y(settings, "fps_hud_y", /* default if not defined*/ 0);
+static properties::property<float> fps_hud_stutter_threshold(settings, "fps_hud_stutter_threshold", /* default if not defined*/ 50);
 
 static properties::property<int> enable_keystroke_hud(settings, "enable_keystroke_hud", /* default if not defined*/ false);
 static properties::property<float> keystroke_hud_x(settings, "keystroke_hud_x", /* default if not defined*/ 0);
@@ -59,6 +65,12 @@ static properties::property<std::string> menubarFocusKey(settings, "menubarFocus
 static properties::property<bool> fullscreen(settings, "fullscreen", /* default if not defined*/ false);
 static properties::property<bool> vsync(settings, "vsync", /* default if not defined*/ true);
 
+static properties::property<bool> enable_lazy_jni_classes(settings, "enable_lazy_jni_classes", /* default if not defined*/ false);
+static properties::property<bool> enable_connection_prewarm(settings, "enable_connection_prewarm", /* default if not defined*/ false);
+// Comma separated, connected in addition to the hosts found in xboxservices.config
+static const std::string defaultPrewarmHosts = "user.auth.xboxlive.com,xsts.auth.xboxlive.com,sisu.xboxlive.com,login.live.com,client.discovery.minecraft-services.net,authorization.franchise.minecraft-services.net";
+static properties::property<std::string> prewarm_hosts(settings, "prewarm_hosts", defaultPrewarmHosts);
+
 std::string Settings::getPath() {
     return PathHelper::getPrimaryDataDirectory() + "mcpelauncher-client-settings.txt";
 }
@@ -82,6 +94,7 @@ void Settings::load() {
     Settings::enable_fps_hud = ::enable_fps_hud.get();
     Settings::fps_hud_x = ::fps_hud_x.get();
     Settings::fps_hud_y = ::fps_hud_y.get();
+    Settings::fps_hud_stutter_threshold = ::fps_hud_stutter_threshold.get();
 
     Settings::enable_keystroke_hud = ::enable_keystroke_hud.get();
     Settings::keystroke_hud_x = ::keystroke_hud_x.get();
@@ -92,6 +105,10 @@ void Settings::load() {
     Settings::menubarFocusKey = ::menubarFocusKey.get();
     Settings::fullscreen = ::fullscreen.get();
     Settings::vsync = ::vsync.get();
+
+    Settings::enable_lazy_jni_classes = ::enable_lazy_jni_classes.get();
+    Settings::enable_connection_prewarm = ::enable_connection_prewarm.get();
+    Settings::prewarm_hosts = ::prewarm_hosts.get();
 }
 
 void Settings::save() {
@@ -108,6 +125,7 @@ void Settings::save() {
     ::enable_fps_hud.set(Settings::enable_fps_hud);
     ::fps_hud_x.set(Settings::fps_hud_x);
     ::fps_hud_y.set(Settings::fps_hud_y);
+    ::fps_hud_stutter_threshold.set(Settings::fps_hud_stutter_threshold);
 
     ::enable_keystroke_hud.set(Settings::enable_keystroke_hud);
     ::keystroke_hud_x.set(Settings::keystroke_hud_x);
@@ -119,6 +137,12 @@ void Settings::save() {
     std::ofstream propertiesFile(getPath());
     ::fullscreen.set(Settings::fullscreen);
     ::vsync.set(Settings::vsync);
+    ::enable_lazy_jni_classes.set(Settings::enable_lazy_jni_classes);
+    ::enable_connection_prewarm.set(Settings::enable_connection_prewarm);
+    // Only persisted once changed, otherwise updates to the default list would never reach existing installs
+    if(Settings::prewarm_hosts != defaultPrewarmHosts || ::prewarm_hosts.get() != defaultPrewarmHosts) {
+        ::prewarm_hosts.set(Settings::prewarm_hosts);
+    }
     if(propertiesFile) {
         settings.save(propertiesFile);
     }
@@ -14,6 +14,7 @@ struct Settings {
     static int enable_fps_hud;
     static float fps_hud_x;
     static float fps_hud_y;
+    static float fps_hud_stutter_threshold;
 
     static int enable_keystroke_hud;
     static float keystroke_hud_x;
@@ -26,6 +27,10 @@ struct Settings {
     static bool fullscreen;
     static bool vsync;
 
+    static bool enable_lazy_jni_classes;
+    static bool enable_connection_prewarm;
+    static std::string prewarm_hosts;
+
     static std::string getPath();
     static void load();
     static void save();
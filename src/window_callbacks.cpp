@@ -25,6 +25,10 @@ void WindowCallbacks::registerCallbacks() {
     using namespace std::placeholders;
     window.setWindowSizeCallback(std::bind(&WindowCallbacks::onWindowSizeCallback, this, _1, _2));
     window.setCloseCallback(std::bind(&WindowCallbacks::onClose, this));
+    // The offscreen window has no input devices, the game only ever sees an empty input queue
+    if(options.headless) {
+        return;
+    }
 
     window.setMouseButtonCallback(std::bind(&WindowCallbacks::onMouseButton, this, _1, _2, _3, _4));
     window.setMousePositionCallback(std::bind(&WindowCallbacks::onMousePosition, this, _1, _2));